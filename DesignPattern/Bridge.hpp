@@ -1,5 +1,11 @@
+#pragma once
+
+#include <concepts>
 #include <iostream>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 
 /// 最核心的就是抽象与实现分离，这样抽象和实现修改起来就都很方便
@@ -11,6 +17,7 @@ class Implementor
 {
 public:
 	virtual void OperationImpl() = 0;
+	virtual ~Implementor() {};
 };
 
 // 具体实现
@@ -103,3 +110,131 @@ public:
 		std::cout << "paintShape: Cube" << std::endl;
 	}
 };
+
+
+// ---------- 编译期桥接 ----------
+// 上面的写法每画一次都要两次虚函数调用：形状画笔本身一次，桥接过去的颜色画笔一次
+// 而且复制桥接器时 shared_ptr 还要做一次原子的引用计数
+// 颜色和形状的组合在编译期就能确定时，可以把颜色画笔作为模板参数直接放进形状画笔里
+// 调用关系在编译期就确定了，热点循环里颜色画笔可以被完全内联
+
+// 颜色画笔只需要提供 PaintColor()，不要求继承 AbsColorPainter
+template <typename T>
+concept ColorPainterImpl = requires(T& painter) { painter.PaintColor(); };
+
+// CRTP 形状画笔，派生类提供 PaintShapeImpl()
+template <typename TDerived, ColorPainterImpl TColorPainter>
+class StaticShapePainter
+{
+public:
+	StaticShapePainter() = default;
+	explicit StaticShapePainter(TColorPainter colorPainter) : m_ColorPainter(std::move(colorPainter)) {};
+
+	void PaintShape()
+	{
+		// 用限定名调用，即使颜色画笔是 AbsColorPainter 的派生类也不会查虚函数表
+		m_ColorPainter.TColorPainter::PaintColor();
+		static_cast<TDerived*>(this)->PaintShapeImpl();
+	}
+
+	TColorPainter& ColorPainter() { return m_ColorPainter; }
+
+protected:
+	// 按值持有，复制桥接器就是复制颜色画笔本身，没有引用计数
+	TColorPainter m_ColorPainter{};
+};
+
+template <ColorPainterImpl TColorPainter>
+class StaticCubeShapePainter : public StaticShapePainter<StaticCubeShapePainter<TColorPainter>, TColorPainter>
+{
+	friend StaticShapePainter<StaticCubeShapePainter, TColorPainter>;
+
+public:
+	using StaticShapePainter<StaticCubeShapePainter, TColorPainter>::StaticShapePainter;
+
+private:
+	void PaintShapeImpl()
+	{
+		std::cout << "paintShape: Cube" << std::endl;
+	}
+};
+
+// Abstraction/Implementor 的编译期版本
+template <typename TImplementor>
+class StaticAbstraction
+{
+public:
+	StaticAbstraction() = default;
+	explicit StaticAbstraction(TImplementor impl) : m_Impl(std::move(impl)) {};
+
+	void Operation()
+	{
+		m_Impl.TImplementor::OperationImpl();
+	}
+
+protected:
+	TImplementor m_Impl{};
+};
+
+// 用法：
+//		StaticCubeShapePainter<RedColorPainter> painter;
+//		painter.PaintShape();
+
+
+// ---------- 封闭集合的桥接 ----------
+// 颜色要在运行时选择，但所有的颜色在编译期都是已知的
+// 这时用 std::variant 代替基类指针：颜色画笔按值存放在桥接器里，不需要分配
+// std::visit 按下标跳转到对应的分支，每个分支里都是直接调用，可以内联
+// 新增颜色时需要加到模板参数里，这是封闭集合换来的代价
+template <typename TDerived, ColorPainterImpl ...TColorPainters>
+class VariantShapePainter
+{
+public:
+	using ColorPainterVariant = std::variant<TColorPainters...>;
+
+	template <typename TColorPainter>
+		requires (std::same_as<std::remove_cvref_t<TColorPainter>, TColorPainters> || ...)
+	explicit VariantShapePainter(TColorPainter&& colorPainter) : m_varColorPainter(std::forward<TColorPainter>(colorPainter)) {};
+
+	void PaintShape()
+	{
+		std::visit([](auto& colorPainter) {
+			using TColorPainter = std::remove_cvref_t<decltype(colorPainter)>;
+			colorPainter.TColorPainter::PaintColor();
+			}, m_varColorPainter);
+		static_cast<TDerived*>(this)->PaintShapeImpl();
+	}
+
+	// 运行时换一种颜色
+	template <typename TColorPainter>
+	void SetColorPainter(TColorPainter&& colorPainter)
+	{
+		m_varColorPainter = std::forward<TColorPainter>(colorPainter);
+	}
+
+protected:
+	ColorPainterVariant m_varColorPainter;
+};
+
+template <ColorPainterImpl ...TColorPainters>
+class VariantCubeShapePainter : public VariantShapePainter<VariantCubeShapePainter<TColorPainters...>, TColorPainters...>
+{
+	friend VariantShapePainter<VariantCubeShapePainter, TColorPainters...>;
+
+public:
+	using VariantShapePainter<VariantCubeShapePainter, TColorPainters...>::VariantShapePainter;
+
+private:
+	void PaintShapeImpl()
+	{
+		std::cout << "paintShape: Cube" << std::endl;
+	}
+};
+
+// 例子中的两种颜色
+using CubePainter = VariantCubeShapePainter<RedColorPainter, BlueColorPainter>;
+
+// 用法：
+//		CubePainter painter{ BlueColorPainter{} };
+//		painter.PaintShape();
+//		painter.SetColorPainter(RedColorPainter{});
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Bridge.hpp"
+
+/// 批量绘制
+/// PaintShape 一个图形一次虚函数调用，而且每一行都用 std::endl 刷新一次
+/// 一帧有上百万个图形时，时间都花在分派和系统调用上了
+///
+/// 批量接口先按（形状画笔、颜色画笔）把记录分组，同一组的数据按列存放（SoA）
+/// 每一组只分派一次：颜色画笔设置一次颜色，形状画笔在一个循环里画完这一组所有的图形
+/// 输出追加到调用方提供的缓冲区里，什么时候写出去、写到哪里由调用方决定
+
+// 一个要画的图形，形状和颜色是在 ShapeBatchPainter 中登记画笔时返回的编号
+struct ShapeRecord
+{
+	std::uint32_t m_nShape;
+	std::uint32_t m_nColor;
+	float m_fX;
+	float m_fY;
+	float m_fSize;
+};
+
+// 同一组图形的数据，按列存放
+struct ShapeColumns
+{
+	std::vector<float> m_vecX;
+	std::vector<float> m_vecY;
+	std::vector<float> m_vecSize;
+
+	std::size_t Size() const { return m_vecX.size(); }
+
+	void Push(const ShapeRecord& record)
+	{
+		m_vecX.push_back(record.m_fX);
+		m_vecY.push_back(record.m_fY);
+		m_vecSize.push_back(record.m_fSize);
+	}
+
+	// 保留容量，下一帧不需要重新分配
+	void Clear()
+	{
+		m_vecX.clear();
+		m_vecY.clear();
+		m_vecSize.clear();
+	}
+};
+
+// 批量颜色画笔，每组调用一次
+class AbsBatchColorPainter
+{
+public:
+	virtual void PaintColors(const ShapeColumns& columns, std::string& buffer) = 0;
+	virtual ~AbsBatchColorPainter() {};
+};
+
+// 批量形状画笔，每组调用一次，在一个循环里画完这一组
+class AbsBatchShapePainter
+{
+public:
+	virtual void PaintShapes(const ShapeColumns& columns, std::string& buffer) = 0;
+	virtual ~AbsBatchShapePainter() {};
+};
+
+// 例子中的画笔同时实现逐个绘制和批量绘制的接口，两种桥接方式都能用
+class BatchRedColorPainter : public RedColorPainter, public AbsBatchColorPainter
+{
+public:
+	void PaintColors(const ShapeColumns&, std::string& buffer) override
+	{
+		buffer += "paintColor: Red\n";
+	}
+};
+
+class BatchBlueColorPainter : public BlueColorPainter, public AbsBatchColorPainter
+{
+public:
+	void PaintColors(const ShapeColumns&, std::string& buffer) override
+	{
+		buffer += "paintColor: Blue\n";
+	}
+};
+
+class BatchCubeShapePainter : public AbsBatchShapePainter
+{
+public:
+	void PaintShapes(const ShapeColumns& columns, std::string& buffer) override
+	{
+		// 每个图形一行：paintShape: Cube x y size
+		constexpr std::string_view kPrefix = "paintShape: Cube";
+		constexpr std::size_t kMaxLineSize = kPrefix.size() + 3 * 32 + 1;
+		buffer.reserve(buffer.size() + columns.Size() * kMaxLineSize);
+		char line[kMaxLineSize];
+		kPrefix.copy(line, kPrefix.size());
+		for (std::size_t i = 0; i < columns.Size(); ++i)
+		{
+			auto p = line + kPrefix.size();
+			for (auto fValue : { columns.m_vecX[i], columns.m_vecY[i], columns.m_vecSize[i] })
+			{
+				*p++ = ' ';
+				p = std::to_chars(p, line + kMaxLineSize, fValue).ptr;
+			}
+			*p++ = '\n';
+			buffer.append(line, p);
+		}
+	}
+};
+
+// 登记画笔并按组分派
+//		ShapeBatchPainter painter;
+//		auto cube = painter.AddShapePainter(std::make_shared<BatchCubeShapePainter>());
+//		auto red = painter.AddColorPainter(std::make_shared<BatchRedColorPainter>());
+//		std::string buffer;
+//		painter.PaintShapes(records, buffer);
+//		std::cout << buffer;
+class ShapeBatchPainter
+{
+public:
+	std::uint32_t AddShapePainter(std::shared_ptr<AbsBatchShapePainter> p)
+	{
+		m_vecShapePainters.push_back(std::move(p));
+		return static_cast<std::uint32_t>(m_vecShapePainters.size() - 1);
+	}
+
+	std::uint32_t AddColorPainter(std::shared_ptr<AbsBatchColorPainter> p)
+	{
+		m_vecColorPainters.push_back(std::move(p));
+		return static_cast<std::uint32_t>(m_vecColorPainters.size() - 1);
+	}
+
+	// 组按（形状、颜色）的编号顺序绘制，组内保持记录原来的顺序
+	// 记录里的编号没有登记过时抛出 std::out_of_range，这一帧什么都不画
+	// 画笔抛出异常时已经分好的组也会被清空，不会留到下一帧再画一次
+	void PaintShapes(std::span<const ShapeRecord> records, std::string& buffer)
+	{
+		auto nShapeCount = m_vecShapePainters.size();
+		auto nColorCount = m_vecColorPainters.size();
+		m_vecGroups.resize(nShapeCount * nColorCount);
+		GroupsGuard guard{ m_vecGroups };
+		for (const auto& record : records)
+		{
+			if (record.m_nShape >= nShapeCount || record.m_nColor >= nColorCount)
+			{
+				throw std::out_of_range("unregistered painter in shape record: shape "
+					+ std::to_string(record.m_nShape) + ", color " + std::to_string(record.m_nColor));
+			}
+			m_vecGroups[record.m_nShape * nColorCount + record.m_nColor].Push(record);
+		}
+		for (std::size_t i = 0; i < m_vecGroups.size(); ++i)
+		{
+			auto& columns = m_vecGroups[i];
+			if (columns.Size() == 0)
+			{
+				continue;
+			}
+			m_vecColorPainters[i % nColorCount]->PaintColors(columns, buffer);
+			m_vecShapePainters[i / nColorCount]->PaintShapes(columns, buffer);
+		}
+	}
+
+private:
+	// 不管是正常结束还是抛出异常，离开 PaintShapes 时都清空所有的组，容量留给下一帧
+	struct GroupsGuard
+	{
+		std::vector<ShapeColumns>& m_vecGroups;
+
+		~GroupsGuard()
+		{
+			for (auto& columns : m_vecGroups)
+			{
+				columns.Clear();
+			}
+		}
+	};
+
+private:
+	std::vector<std::shared_ptr<AbsBatchShapePainter>> m_vecShapePainters;
+	std::vector<std::shared_ptr<AbsBatchColorPainter>> m_vecColorPainters;
+	// 下标是 形状 * 颜色数 + 颜色，每一帧复用
+	std::vector<ShapeColumns> m_vecGroups;
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "Bridge.hpp"
+
+/// 桥接器持有实现的方式
+/// Abstraction 和 AbsShapePainter 都用 shared_ptr 持有实现，每建一个桥接器就有一次原子的引用计数
+/// make_shared 还要分配一次（main.cpp 里一个画笔就是两次 make_shared）
+/// 这对长期存在、多处共享的桥接器没有问题，但每个请求都临时建一个画笔时，这些开销就都是多余的
+///
+/// 这里把持有方式作为模板参数：
+///		SharedOwnership		和原来一样，shared_ptr
+///		UniqueOwnership		桥接器独占实现，unique_ptr，没有引用计数
+///		BorrowedOwnership	只是借用，实现由调用方持有（例如栈上的对象），不分配也不计数
+///		IntrusiveOwnership	引用计数放在对象里，不需要控制块，计数不是原子的，只能在同一个线程里共享
+///		ArenaOwnership		实现和桥接器都放在 PainterArena 里，arena 析构时统一销毁，不逐个释放
+///
+///		RedColorPainter red;
+///		BasicCubeShapePainter<BorrowedOwnership> painter(red);
+///		painter.PaintShape();
+
+
+// ---------- Borrowed ----------
+// 不持有的引用，和指针一样可以用 -> 访问
+template <typename T>
+class Borrowed
+{
+public:
+	Borrowed(T& ref) noexcept : m_pRef(std::addressof(ref)) {};
+
+	template <typename U>
+		requires std::convertible_to<U*, T*>
+	Borrowed(Borrowed<U> ref) noexcept : m_pRef(ref.Get()) {};
+
+	T* Get() const noexcept { return m_pRef; }
+	T* operator->() const noexcept { return m_pRef; }
+	T& operator*() const noexcept { return *m_pRef; }
+
+private:
+	T* m_pRef;
+};
+
+
+// ---------- Intrusive ----------
+// 需要被 IntrusivePtr 持有的类型额外继承它，计数就放在对象里
+class IntrusiveRefCount
+{
+	template <typename> friend class IntrusivePtr;
+
+public:
+	IntrusiveRefCount() noexcept = default;
+	// 计数属于对象本身，不属于它的值：复制出来的是一个还没有被任何 IntrusivePtr 持有的新对象
+	IntrusiveRefCount(const IntrusiveRefCount&) noexcept {};
+	// 赋值只改变对象的值，持有它的 IntrusivePtr 还是那几个，计数保持不变
+	IntrusiveRefCount& operator=(const IntrusiveRefCount&) noexcept { return *this; };
+	virtual ~IntrusiveRefCount() {};
+
+private:
+	std::size_t m_nRefCount = 0;
+};
+
+// 给已有的实现加上引用计数，例如 Intrusive<RedColorPainter>
+template <typename T>
+class Intrusive : public T, public IntrusiveRefCount
+{
+public:
+	using T::T;
+};
+
+template <typename T>
+class IntrusivePtr
+{
+	template <typename> friend class IntrusivePtr;
+
+public:
+	IntrusivePtr() noexcept = default;
+
+	template <typename U>
+		requires std::convertible_to<U*, T*> && std::derived_from<U, IntrusiveRefCount>
+	explicit IntrusivePtr(U* p) noexcept : m_p(p), m_pRefCount(p)
+	{
+		AddRef();
+	}
+
+	template <typename U>
+		requires std::convertible_to<U*, T*>
+	IntrusivePtr(const IntrusivePtr<U>& p) noexcept : m_p(p.m_p), m_pRefCount(p.m_pRefCount)
+	{
+		AddRef();
+	}
+
+	template <typename U>
+		requires std::convertible_to<U*, T*>
+	IntrusivePtr(IntrusivePtr<U>&& p) noexcept
+		: m_p(std::exchange(p.m_p, nullptr)), m_pRefCount(std::exchange(p.m_pRefCount, nullptr)) {};
+
+	IntrusivePtr(const IntrusivePtr& p) noexcept : m_p(p.m_p), m_pRefCount(p.m_pRefCount)
+	{
+		AddRef();
+	}
+
+	IntrusivePtr(IntrusivePtr&& p) noexcept
+		: m_p(std::exchange(p.m_p, nullptr)), m_pRefCount(std::exchange(p.m_pRefCount, nullptr)) {};
+
+	IntrusivePtr& operator=(IntrusivePtr p) noexcept
+	{
+		std::swap(m_p, p.m_p);
+		std::swap(m_pRefCount, p.m_pRefCount);
+		return *this;
+	}
+
+	~IntrusivePtr()
+	{
+		if (m_pRefCount != nullptr && --m_pRefCount->m_nRefCount == 0)
+		{
+			delete m_pRefCount;
+		}
+	}
+
+	T* Get() const noexcept { return m_p; }
+	T* operator->() const noexcept { return m_p; }
+	T& operator*() const noexcept { return *m_p; }
+	explicit operator bool() const noexcept { return m_p != nullptr; }
+
+private:
+	void AddRef() noexcept
+	{
+		if (m_pRefCount != nullptr)
+		{
+			++m_pRefCount->m_nRefCount;
+		}
+	}
+
+private:
+	T* m_p = nullptr;
+	// 同一个对象的另一个基类，通过它找到计数，也通过它的虚析构函数销毁整个对象
+	IntrusiveRefCount* m_pRefCount = nullptr;
+};
+
+// 只分配一次，没有单独的控制块
+template <typename T, typename ...TArgs>
+IntrusivePtr<Intrusive<T>> MakeIntrusive(TArgs&&... args)
+{
+	return IntrusivePtr<Intrusive<T>>(new Intrusive<T>(std::forward<TArgs>(args)...));
+}
+
+
+// ---------- Arena ----------
+// 一次请求里的画笔都从同一块内存里分配，arena 析构时按创建的相反顺序调用析构函数
+// 可以给一块栈上的缓冲区，放得下时就完全不用堆
+//		std::byte buffer[1024];
+//		PainterArena arena(buffer, sizeof(buffer));
+//		auto& painter = arena.New<BasicCubeShapePainter<ArenaOwnership>>(arena.New<RedColorPainter>());
+class PainterArena
+{
+	struct Node
+	{
+		Node* m_pNext;
+		void (*m_pfnDestroy)(void* p);
+		void* m_pObject;
+	};
+
+public:
+	PainterArena() = default;
+
+	PainterArena(void* pBuffer, std::size_t nSize)
+		: m_Resource(pBuffer, nSize, std::pmr::get_default_resource()) {};
+
+	PainterArena(PainterArena&) = delete;
+	PainterArena& operator=(PainterArena&) = delete;
+
+	~PainterArena()
+	{
+		for (auto pNode = m_pHead; pNode != nullptr; pNode = pNode->m_pNext)
+		{
+			pNode->m_pfnDestroy(pNode->m_pObject);
+		}
+	}
+
+	template <typename T, typename ...TArgs>
+	T& New(TArgs&&... args)
+	{
+		auto pMemory = m_Resource.allocate(sizeof(T), alignof(T));
+		auto pObject = ::new (pMemory) T(std::forward<TArgs>(args)...);
+		if constexpr (!std::is_trivially_destructible_v<T>)
+		{
+			auto pNode = static_cast<Node*>(m_Resource.allocate(sizeof(Node), alignof(Node)));
+			m_pHead = ::new (pNode) Node{ m_pHead, [](void* p) { static_cast<T*>(p)->~T(); }, pObject };
+		}
+		return *pObject;
+	}
+
+private:
+	std::pmr::monotonic_buffer_resource m_Resource;
+	// 后创建的在前面，先析构
+	Node* m_pHead = nullptr;
+};
+
+
+// ---------- Ownership Policies ----------
+struct SharedOwnership
+{
+	template <typename T>
+	using Holder = std::shared_ptr<T>;
+};
+
+struct UniqueOwnership
+{
+	template <typename T>
+	using Holder = std::unique_ptr<T>;
+};
+
+struct BorrowedOwnership
+{
+	template <typename T>
+	using Holder = Borrowed<T>;
+};
+
+struct IntrusiveOwnership
+{
+	template <typename T>
+	using Holder = IntrusivePtr<T>;
+};
+
+// 对桥接器来说 arena 里的对象也是借用的，由 arena 负责销毁
+struct ArenaOwnership
+{
+	template <typename T>
+	using Holder = Borrowed<T>;
+};
+
+
+// ---------- Bridges ----------
+// 和 Abstraction/RedfinedAbstrction 一样，只是持有方式由 TOwnership 决定
+template <typename TOwnership>
+class BasicAbstraction
+{
+public:
+	using ImplementorHolder = typename TOwnership::template Holder<Implementor>;
+
+	explicit BasicAbstraction(ImplementorHolder pImpl) : m_pImpl(std::move(pImpl)) {};
+	virtual ~BasicAbstraction() {};
+
+	virtual void Operation() = 0;
+
+protected:
+	ImplementorHolder m_pImpl;
+};
+
+template <typename TOwnership>
+class BasicRefinedAbstraction : public BasicAbstraction<TOwnership>
+{
+public:
+	using BasicAbstraction<TOwnership>::BasicAbstraction;
+
+	void Operation() override
+	{
+		this->m_pImpl->OperationImpl();
+	}
+};
+
+// 和 AbsShapePainter/CubeShapePainter 一样，只是持有方式由 TOwnership 决定
+template <typename TOwnership>
+class BasicShapePainter
+{
+public:
+	using ColorPainterHolder = typename TOwnership::template Holder<AbsColorPainter>;
+
+	explicit BasicShapePainter(ColorPainterHolder pColorPainter) : m_pColorPainter(std::move(pColorPainter)) {};
+	virtual ~BasicShapePainter() {};
+
+	virtual void PaintShape() = 0;
+
+protected:
+	ColorPainterHolder m_pColorPainter;
+};
+
+template <typename TOwnership>
+class BasicCubeShapePainter : public BasicShapePainter<TOwnership>
+{
+public:
+	using BasicShapePainter<TOwnership>::BasicShapePainter;
+
+	void PaintShape() override
+	{
+		this->m_pColorPainter->PaintColor();
+		std::cout << "paintShape: Cube" << std::endl;
+	}
+};
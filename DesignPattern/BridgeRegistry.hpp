@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Bridge.hpp"
+
+/// 享元：共享无状态的实现
+/// main.cpp 每建一个 CubeShapePainter 都会新建一个 RedColorPainter，但颜色画笔本身没有状态
+/// 同一种颜色完全可以只有一个实例，所有的形状画笔共享它
+///
+/// FlyweightRegistry 按名字保存实现，读多写少：
+///		1. 查找不加锁，读的是一份不可变的快照，只有一次 acquire 的原子读
+///		2. 登记时加锁，复制一份新的快照，改完之后整体替换（RCU）
+///		   旧的快照可能还有别的线程在读，所以不马上释放，等注册表析构时一起释放
+///		   登记通常只发生在启动阶段，留下的旧快照数量就是登记的次数
+/// 登记过的实现不会被删除，Find 返回的指针在注册表的整个生命周期内都有效
+///
+///		auto& colors = ColorPainters();
+///		std::shared_ptr<AbsColorPainter> red = colors.Get("Red");
+///		std::shared_ptr<AbsShapePainter> painter = std::make_shared<CubeShapePainter>(red);
+
+template <typename TInterface>
+class FlyweightRegistry
+{
+	// 允许直接用 std::string_view 查找，不需要先构造 std::string
+	struct KeyHash
+	{
+		using is_transparent = void;
+
+		std::size_t operator()(std::string_view key) const noexcept
+		{
+			return std::hash<std::string_view>{}(key);
+		}
+	};
+
+	using Snapshot = std::unordered_map<std::string, std::shared_ptr<TInterface>, KeyHash, std::equal_to<>>;
+
+public:
+	FlyweightRegistry()
+	{
+		m_vecSnapshots.push_back(std::make_unique<Snapshot>());
+		m_pSnapshot.store(m_vecSnapshots.back().get(), std::memory_order_release);
+	}
+
+	FlyweightRegistry(FlyweightRegistry&) = delete;
+	FlyweightRegistry& operator=(FlyweightRegistry&) = delete;
+
+	// 不加锁，也不改引用计数，找不到时返回 nullptr
+	TInterface* Find(std::string_view key) const
+	{
+		auto pSnapshot = m_pSnapshot.load(std::memory_order_acquire);
+		auto it = pSnapshot->find(key);
+		return it != pSnapshot->end() ? it->second.get() : nullptr;
+	}
+
+	// 需要 shared_ptr 时（例如交给 AbsShapePainter），多一次引用计数
+	std::shared_ptr<TInterface> Get(std::string_view key) const
+	{
+		auto pSnapshot = m_pSnapshot.load(std::memory_order_acquire);
+		auto it = pSnapshot->find(key);
+		return it != pSnapshot->end() ? it->second : nullptr;
+	}
+
+	// 已经有同名的实现时直接返回它，否则用 args 构造一个 T 登记进去
+	template <typename T, typename ...TArgs>
+	std::shared_ptr<TInterface> Intern(std::string_view key, TArgs&&... args)
+	{
+		if (auto pValue = Get(key))
+		{
+			return pValue;
+		}
+		std::lock_guard lock(m_lMutex);
+		auto pOld = m_pSnapshot.load(std::memory_order_relaxed);
+		// 等锁的时候可能已经被别人登记了
+		if (auto it = pOld->find(key); it != pOld->end())
+		{
+			return it->second;
+		}
+		std::shared_ptr<TInterface> pValue = std::make_shared<T>(std::forward<TArgs>(args)...);
+		auto pNew = std::make_unique<Snapshot>(*pOld);
+		pNew->emplace(std::string(key), pValue);
+		m_pSnapshot.store(pNew.get(), std::memory_order_release);
+		m_vecSnapshots.push_back(std::move(pNew));
+		return pValue;
+	}
+
+	std::size_t Size() const
+	{
+		return m_pSnapshot.load(std::memory_order_acquire)->size();
+	}
+
+private:
+	std::atomic<const Snapshot*> m_pSnapshot{ nullptr };
+
+	// 只有持有锁的写者会修改
+	std::mutex m_lMutex;
+	std::vector<std::unique_ptr<const Snapshot>> m_vecSnapshots;
+};
+
+using ColorPainterRegistry = FlyweightRegistry<AbsColorPainter>;
+
+// 全局共享的颜色画笔，第一次使用时登记例子中的两种颜色
+inline ColorPainterRegistry& ColorPainters()
+{
+	static ColorPainterRegistry registry;
+	// 局部静态变量的初始化是线程安全的，只会登记一次
+	[[maybe_unused]] static bool bRegistered = (registry.Intern<RedColorPainter>("Red"), registry.Intern<BlueColorPainter>("Blue"), true);
+	return registry;
+}
+
+
+/// 形状 × 颜色 的画笔矩阵
+/// 启动时把所有的组合都建好，热点路径上按下标取，不再构造任何东西
+/// 建好之后不再修改，任意线程都可以并发读取
+///		auto matrix = ShapePainterMatrix::Create<CubeShapePainter>(ColorPainters(), { "Red", "Blue" });
+///		matrix.At(0, matrix.ColorIndex("Blue")).PaintShape();
+class ShapePainterMatrix
+{
+public:
+	// 每种形状画笔都用 std::shared_ptr<AbsColorPainter>& 构造，和 CubeShapePainter 一样
+	template <typename ...TShapePainters>
+	static ShapePainterMatrix Create(const ColorPainterRegistry& registry, std::initializer_list<std::string_view> colorKeys)
+	{
+		ShapePainterMatrix matrix;
+		for (auto key : colorKeys)
+		{
+			auto pColorPainter = registry.Get(key);
+			if (!pColorPainter)
+			{
+				throw std::invalid_argument("unknown color painter: " + std::string(key));
+			}
+			matrix.m_vecColorKeys.emplace_back(key);
+			matrix.m_vecColorPainters.push_back(std::move(pColorPainter));
+		}
+		matrix.m_nShapeCount = sizeof...(TShapePainters);
+		(matrix.AddShape<TShapePainters>(), ...);
+		return matrix;
+	}
+
+	AbsShapePainter& At(std::size_t nShape, std::size_t nColor) const
+	{
+		return *m_vecPainters[nShape * m_vecColorPainters.size() + nColor];
+	}
+
+	const std::shared_ptr<AbsShapePainter>& Get(std::size_t nShape, std::size_t nColor) const
+	{
+		return m_vecPainters[nShape * m_vecColorPainters.size() + nColor];
+	}
+
+	// 找不到时返回颜色的个数
+	std::size_t ColorIndex(std::string_view key) const
+	{
+		std::size_t i = 0;
+		while (i < m_vecColorKeys.size() && m_vecColorKeys[i] != key)
+		{
+			++i;
+		}
+		return i;
+	}
+
+	std::size_t ShapeCount() const { return m_nShapeCount; }
+	std::size_t ColorCount() const { return m_vecColorPainters.size(); }
+
+private:
+	template <typename TShapePainter>
+	void AddShape()
+	{
+		for (auto& pColorPainter : m_vecColorPainters)
+		{
+			m_vecPainters.push_back(std::make_shared<TShapePainter>(pColorPainter));
+		}
+	}
+
+private:
+	std::size_t m_nShapeCount = 0;
+	std::vector<std::string> m_vecColorKeys;
+	std::vector<std::shared_ptr<AbsColorPainter>> m_vecColorPainters;
+	// 下标是 形状 * 颜色数 + 颜色
+	std::vector<std::shared_ptr<AbsShapePainter>> m_vecPainters;
+};
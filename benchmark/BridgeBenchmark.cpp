@@ -0,0 +1,336 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "DesignPattern/Bridge.hpp"
+#include "DesignPattern/BridgeBatch.hpp"
+#include "DesignPattern/BridgeOwnership.hpp"
+#include "DesignPattern/BridgeRegistry.hpp"
+
+/// Bridge.hpp 中的虚函数调用
+/// 例子里的画笔会输出到 std::cout，测出来的全是 I/O，这里换成只计数的实现
+/// 形状画笔 -> 颜色画笔 是两次虚函数调用，基线是同样两层的直接调用
+/// 编译期桥接和 std::variant 桥接用的是同样的计数画笔
+
+namespace
+{
+	class CountingColorPainter : public AbsColorPainter
+	{
+	public:
+		void PaintColor() override
+		{
+			benchmark::DoNotOptimize(++m_nCount);
+		}
+
+		long m_nCount = 0;
+	};
+
+	class CountingShapePainter : public AbsShapePainter
+	{
+	public:
+		using AbsShapePainter::AbsShapePainter;
+
+		void PaintShape() override
+		{
+			m_pColorPainter->PaintColor();
+		}
+	};
+
+	class CountingImplementor : public Implementor
+	{
+	public:
+		void OperationImpl() override
+		{
+			benchmark::DoNotOptimize(++m_nCount);
+		}
+
+		long m_nCount = 0;
+	};
+
+	class CountingBlueColorPainter : public AbsColorPainter
+	{
+	public:
+		void PaintColor() override
+		{
+			benchmark::DoNotOptimize(m_nCount += 2);
+		}
+
+		long m_nCount = 0;
+	};
+
+	class CountingStaticShapePainter : public StaticShapePainter<CountingStaticShapePainter, CountingColorPainter>
+	{
+		friend StaticShapePainter<CountingStaticShapePainter, CountingColorPainter>;
+
+		void PaintShapeImpl() {}
+	};
+
+	class CountingVariantShapePainter : public VariantShapePainter<CountingVariantShapePainter, CountingColorPainter, CountingBlueColorPainter>
+	{
+		friend VariantShapePainter<CountingVariantShapePainter, CountingColorPainter, CountingBlueColorPainter>;
+
+	public:
+		using VariantShapePainter::VariantShapePainter;
+
+	private:
+		void PaintShapeImpl() {}
+	};
+
+	struct DirectColorPainter
+	{
+		[[gnu::noinline]] void PaintColor()
+		{
+			benchmark::DoNotOptimize(++m_nCount);
+		}
+
+		long m_nCount = 0;
+	};
+
+	struct DirectShapePainter
+	{
+		[[gnu::noinline]] void PaintShape()
+		{
+			m_pColorPainter->PaintColor();
+		}
+
+		DirectColorPainter* m_pColorPainter;
+	};
+}
+
+static void BM_Bridge_DirectCall(benchmark::State& state)
+{
+	DirectColorPainter colorPainter;
+	DirectShapePainter shapePainter{ &colorPainter };
+	for (auto _ : state)
+	{
+		shapePainter.PaintShape();
+	}
+	benchmark::DoNotOptimize(colorPainter.m_nCount);
+}
+BENCHMARK(BM_Bridge_DirectCall);
+
+static void BM_Bridge_ShapePainter(benchmark::State& state)
+{
+	std::shared_ptr<AbsColorPainter> pColorPainter = std::make_shared<CountingColorPainter>();
+	std::shared_ptr<AbsShapePainter> pShapePainter = std::make_shared<CountingShapePainter>(pColorPainter);
+	// 阻止编译器根据 make_shared 的类型去虚化
+	benchmark::DoNotOptimize(pShapePainter.get());
+	for (auto _ : state)
+	{
+		pShapePainter->PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_ShapePainter);
+
+static void BM_Bridge_Abstraction(benchmark::State& state)
+{
+	std::shared_ptr<Implementor> pImplementor = std::make_shared<CountingImplementor>();
+	std::shared_ptr<Abstraction> pAbstraction = std::make_shared<RedfinedAbstrction>(pImplementor);
+	benchmark::DoNotOptimize(pAbstraction.get());
+	for (auto _ : state)
+	{
+		pAbstraction->Operation();
+	}
+}
+BENCHMARK(BM_Bridge_Abstraction);
+
+static void BM_Bridge_Static(benchmark::State& state)
+{
+	CountingStaticShapePainter shapePainter;
+	for (auto _ : state)
+	{
+		shapePainter.PaintShape();
+	}
+	benchmark::DoNotOptimize(shapePainter.ColorPainter().m_nCount);
+}
+BENCHMARK(BM_Bridge_Static);
+
+/// 颜色在运行时决定，编译器看不到 variant 里存放的是哪一种
+static void BM_Bridge_Variant(benchmark::State& state)
+{
+	CountingVariantShapePainter shapePainter{ CountingBlueColorPainter{} };
+	benchmark::DoNotOptimize(&shapePainter);
+	for (auto _ : state)
+	{
+		shapePainter.PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_Variant);
+
+/// ---------- Batch ----------
+/// 同样的记录，逐个分派（每个图形两次虚函数调用）和按组分派，都写进同一个缓冲区
+namespace
+{
+	std::vector<ShapeRecord> MakeRecords(std::size_t n)
+	{
+		std::minstd_rand random(42);
+		std::vector<ShapeRecord> records(n);
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			records[i] = { 0, static_cast<std::uint32_t>(random() % 2), static_cast<float>(i), 1.0f, 0.5f };
+		}
+		return records;
+	}
+}
+
+static void BM_Bridge_PaintShapesPerItem(benchmark::State& state)
+{
+	auto records = MakeRecords(static_cast<std::size_t>(state.range(0)));
+	std::shared_ptr<AbsBatchShapePainter> pShapePainter = std::make_shared<BatchCubeShapePainter>();
+	std::shared_ptr<AbsBatchColorPainter> vecColorPainters[] = { std::make_shared<BatchRedColorPainter>(), std::make_shared<BatchBlueColorPainter>() };
+	ShapeColumns columns;
+	std::string buffer;
+	for (auto _ : state)
+	{
+		buffer.clear();
+		for (const auto& record : records)
+		{
+			columns.Clear();
+			columns.Push(record);
+			vecColorPainters[record.m_nColor]->PaintColors(columns, buffer);
+			pShapePainter->PaintShapes(columns, buffer);
+		}
+		benchmark::DoNotOptimize(buffer.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Bridge_PaintShapesPerItem)->Range(1 << 10, 1 << 16);
+
+static void BM_Bridge_PaintShapes(benchmark::State& state)
+{
+	auto records = MakeRecords(static_cast<std::size_t>(state.range(0)));
+	ShapeBatchPainter painter;
+	painter.AddShapePainter(std::make_shared<BatchCubeShapePainter>());
+	painter.AddColorPainter(std::make_shared<BatchRedColorPainter>());
+	painter.AddColorPainter(std::make_shared<BatchBlueColorPainter>());
+	std::string buffer;
+	for (auto _ : state)
+	{
+		buffer.clear();
+		painter.PaintShapes(records, buffer);
+		benchmark::DoNotOptimize(buffer.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Bridge_PaintShapes)->Range(1 << 10, 1 << 16);
+
+/// ---------- Ownership ----------
+/// 每次迭代临时建一个画笔、画一次再销毁，对比不同持有方式的构造和销毁开销
+namespace
+{
+	template <typename TOwnership>
+	class CountingBasicShapePainter : public BasicShapePainter<TOwnership>
+	{
+	public:
+		using BasicShapePainter<TOwnership>::BasicShapePainter;
+
+		void PaintShape() override
+		{
+			this->m_pColorPainter->PaintColor();
+		}
+	};
+}
+
+/// 和 main.cpp 一样两次 make_shared
+static void BM_Bridge_PerRequestShared(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		std::shared_ptr<AbsColorPainter> pColorPainter = std::make_shared<CountingColorPainter>();
+		std::shared_ptr<AbsShapePainter> pShapePainter = std::make_shared<CountingShapePainter>(pColorPainter);
+		pShapePainter->PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestShared);
+
+static void BM_Bridge_PerRequestUnique(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		CountingBasicShapePainter<UniqueOwnership> shapePainter(std::make_unique<CountingColorPainter>());
+		shapePainter.PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestUnique);
+
+/// 颜色画笔由外面长期持有，每个请求只借用
+static void BM_Bridge_PerRequestBorrowed(benchmark::State& state)
+{
+	CountingColorPainter colorPainter;
+	for (auto _ : state)
+	{
+		CountingBasicShapePainter<BorrowedOwnership> shapePainter(colorPainter);
+		benchmark::DoNotOptimize(&shapePainter);
+		shapePainter.PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestBorrowed);
+
+static void BM_Bridge_PerRequestIntrusive(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		CountingBasicShapePainter<IntrusiveOwnership> shapePainter(MakeIntrusive<CountingColorPainter>());
+		shapePainter.PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestIntrusive);
+
+static void BM_Bridge_PerRequestArena(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		std::byte buffer[256];
+		PainterArena arena(buffer, sizeof(buffer));
+		auto& shapePainter = arena.New<CountingBasicShapePainter<ArenaOwnership>>(arena.New<CountingColorPainter>());
+		benchmark::DoNotOptimize(&shapePainter);
+		shapePainter.PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestArena);
+
+/// ---------- Flyweight ----------
+/// 从注册表里取共享的颜色画笔，不再新建
+static void BM_Bridge_RegistryFind(benchmark::State& state)
+{
+	ColorPainterRegistry registry;
+	registry.Intern<CountingColorPainter>("Red");
+	registry.Intern<CountingBlueColorPainter>("Blue");
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(registry.Find("Blue"));
+	}
+}
+BENCHMARK(BM_Bridge_RegistryFind);
+
+/// 共享的颜色画笔，每个请求新建形状画笔，和 BM_Bridge_PerRequestShared 对比
+static void BM_Bridge_PerRequestInterned(benchmark::State& state)
+{
+	ColorPainterRegistry registry;
+	registry.Intern<CountingColorPainter>("Red");
+	for (auto _ : state)
+	{
+		auto pColorPainter = registry.Get("Red");
+		std::shared_ptr<AbsShapePainter> pShapePainter = std::make_shared<CountingShapePainter>(pColorPainter);
+		pShapePainter->PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_PerRequestInterned);
+
+/// 启动时建好的矩阵，按下标取
+static void BM_Bridge_Matrix(benchmark::State& state)
+{
+	ColorPainterRegistry registry;
+	registry.Intern<CountingColorPainter>("Red");
+	registry.Intern<CountingBlueColorPainter>("Blue");
+	auto matrix = ShapePainterMatrix::Create<CountingShapePainter>(registry, { "Red", "Blue" });
+	std::size_t i = 0;
+	for (auto _ : state)
+	{
+		matrix.At(0, ++i & 1).PaintShape();
+	}
+}
+BENCHMARK(BM_Bridge_Matrix);
@@ -0,0 +1,631 @@
+#include <benchmark/benchmark.h>
+
+#include <numeric>
+#include <vector>
+
+#include "coroutine/ZExample4/Executor.h"
+#include "coroutine/ZExample4/Generator.h"
+#include "coroutine/ZExample4/GeneratorChunk.h"
+#include "coroutine/ZExample4/GeneratorPipe.h"
+#include "coroutine/ZExample4/GeneratorTable.h"
+
+/// Generator 和组合子（map/flat_map/fold/filter/take/take_while/for_each，和 ZExample2 中的一致）
+/// 每一组都有一个做同样计算的普通循环作为基线，差值就是协程切换和组合子本身的开销
+/// BM_Chunk_* 是同样的计算换成 GeneratorChunk，每块（256 个）只恢复一次
+/// BM_Fused_* 是同样的链换成 fused:: 管道，除了 flat_map 之外没有中间的协程
+
+namespace
+{
+	Generator<int> Range(int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			co_yield i;
+		}
+	}
+
+	// 和 ZExample2 的 fibonacci() 一样，只是换成了不会溢出的 std::uint64_t
+	Generator<std::uint64_t> Fibonacci()
+	{
+		std::uint64_t a = 0;
+		std::uint64_t b = 1;
+		while (true)
+		{
+			co_yield a;
+			b = a + b;
+			a = b - a;
+		}
+	}
+
+	// 模拟解析之类的计算，每次大约几百纳秒，编译器无法提前算出结果
+	std::uint64_t Work(std::uint64_t x)
+	{
+		for (int i = 0; i < 256; ++i)
+		{
+			x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+			benchmark::DoNotOptimize(x);
+		}
+		return x;
+	}
+
+	Generator<std::uint64_t> ExpensiveRange(int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			co_yield Work(static_cast<std::uint64_t>(i));
+		}
+	}
+
+	// GeneratorChunk::from_array 的数据源，内容和 Range(n) 相同
+	std::vector<int> Iota(int n)
+	{
+		std::vector<int> values(static_cast<std::size_t>(n));
+		std::iota(values.begin(), values.end(), 0);
+		return values;
+	}
+
+	constexpr int kMin = 1 << 10;
+	constexpr int kMax = 1 << 16;
+}
+
+/// ---------- Iteration ----------
+static void BM_Loop_Sum(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			benchmark::DoNotOptimize(sum += i);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Sum)->Range(kMin, kMax);
+
+static void BM_Generator_Next(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		auto gen = Range(n);
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += gen.next());
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Next)->Range(kMin, kMax);
+
+static void BM_Generator_RangeFor(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (auto i : Range(n))
+		{
+			benchmark::DoNotOptimize(sum += i);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_RangeFor)->Range(kMin, kMax);
+
+/// ---------- map ----------
+static void BM_Loop_Map(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			benchmark::DoNotOptimize(sum += i * 3);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Map)->Range(kMin, kMax);
+
+static void BM_Generator_Map(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(n)
+			.map([](int i) {
+			return i * 3;
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Map)->Range(kMin, kMax);
+
+/// map(std::function) 多一次类型擦除的间接调用
+static void BM_Generator_MapFunction(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(n)
+			.map(std::function<int(int)>([](int i) {
+			return i * 3;
+				}))
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_MapFunction)->Range(kMin, kMax);
+
+static void BM_Chunk_Map(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	auto values = Iota(n);
+	for (auto _ : state)
+	{
+		long sum = 0;
+		GeneratorChunk<int>::from_array(values.data(), values.size())
+			.map([](int i) {
+			return i * 3;
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Chunk_Map)->Range(kMin, kMax);
+
+/// ---------- filter ----------
+static void BM_Loop_Filter(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			if (i & 1)
+			{
+				benchmark::DoNotOptimize(sum += i);
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Filter)->Range(kMin, kMax);
+
+static void BM_Generator_Filter(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(n)
+			.filter([](int i) {
+			return (i & 1) == 1;
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Filter)->Range(kMin, kMax);
+
+static void BM_Chunk_Filter(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	auto values = Iota(n);
+	for (auto _ : state)
+	{
+		long sum = 0;
+		GeneratorChunk<int>::from_array(values.data(), values.size())
+			.filter([](int i) {
+			return (i & 1) == 1;
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Chunk_Filter)->Range(kMin, kMax);
+
+/// ---------- take / take_while ----------
+/// 源是无限序列，take 之后不再恢复上游
+static void BM_Loop_Take(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			benchmark::DoNotOptimize(sum += i);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Take)->Range(kMin, kMax);
+
+static void BM_Generator_Take(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(std::numeric_limits<int>::max())
+			.take(n)
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Take)->Range(kMin, kMax);
+
+static void BM_Generator_TakeWhile(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(std::numeric_limits<int>::max())
+			.take_while([n](int i) {
+			return i < n;
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_TakeWhile)->Range(kMin, kMax);
+
+/// ---------- fold ----------
+static void BM_Loop_Fold(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long acc = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			acc = acc * 31 + i;
+			benchmark::DoNotOptimize(acc);
+		}
+		benchmark::DoNotOptimize(acc);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Fold)->Range(kMin, kMax);
+
+static void BM_Generator_Fold(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		auto acc = Range(n).fold(0L, [](long acc, int i) {
+			acc = acc * 31 + i;
+			benchmark::DoNotOptimize(acc);
+			return acc;
+			});
+		benchmark::DoNotOptimize(acc);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Fold)->Range(kMin, kMax);
+
+static void BM_Chunk_Fold(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	auto values = Iota(n);
+	for (auto _ : state)
+	{
+		auto acc = GeneratorChunk<int>::from_array(values.data(), values.size()).fold(0L, [](long acc, int i) {
+			acc = acc * 31 + i;
+			benchmark::DoNotOptimize(acc);
+			return acc;
+			});
+		benchmark::DoNotOptimize(acc);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Chunk_Fold)->Range(kMin, kMax);
+
+/// ---------- flat_map ----------
+/// 每个元素展开成 0..3 共 4 个值，每个元素都要新建一个内层 Generator
+static void BM_Loop_FlatMap(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				benchmark::DoNotOptimize(sum += i + j);
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n * 4);
+}
+BENCHMARK(BM_Loop_FlatMap)->Range(kMin, kMax);
+
+static void BM_Generator_FlatMap(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(n)
+			.flat_map([](int i) -> Generator<int> {
+			for (int j = 0; j < 4; ++j)
+			{
+				co_yield i + j;
+			}
+				})
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n * 4);
+}
+BENCHMARK(BM_Generator_FlatMap)->Range(kMin, kMax);
+
+/// ---------- Chain ----------
+/// ZExample2 最后的那条链：filter -> map -> flat_map -> take
+static void BM_Loop_Chain(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		int nTaken = 0;
+		for (int i = 0; i < std::numeric_limits<int>::max() && nTaken < n; ++i)
+		{
+			if ((i & 1) == 0)
+			{
+				continue;
+			}
+			auto k = i * 3;
+			for (int j = 0; j < k && nTaken < n; ++j, ++nTaken)
+			{
+				benchmark::DoNotOptimize(sum += j);
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Loop_Chain)->Range(kMin, kMax);
+
+static void BM_Generator_Chain(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(std::numeric_limits<int>::max())
+			.filter([](int i) {
+			return (i & 1) == 1;
+				})
+			.map([](int i) {
+			return i * 3;
+				})
+			.flat_map([](int i) -> Generator<int> {
+			for (int j = 0; j < i; ++j)
+			{
+				co_yield j;
+			}
+				})
+			.take(n)
+			.for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Chain)->Range(kMin, kMax);
+
+/// 上游仍然是 Range 协程，filter/map/take 融合进同一个循环，只有 flat_map 的子 Generator 是协程
+static void BM_Fused_Chain(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		Range(std::numeric_limits<int>::max())
+			| fused::filter([](int i) {
+			return (i & 1) == 1;
+				})
+			| fused::map([](int i) {
+			return i * 3;
+				})
+			| fused::flat_map([](int i) -> Generator<int> {
+			for (int j = 0; j < i; ++j)
+			{
+				co_yield j;
+			}
+				})
+			| fused::take(static_cast<std::size_t>(n))
+			| fused::for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Fused_Chain)->Range(kMin, kMax);
+
+/// 上游换成数组，源头也不再是协程；1024 个源值展开后远多于 kMax
+static void BM_Fused_ChainSpan(benchmark::State& state)
+{
+	auto n = static_cast<int>(state.range(0));
+	auto values = Iota(1024);
+	for (auto _ : state)
+	{
+		long sum = 0;
+		fused::from(values)
+			| fused::filter([](int i) {
+			return (i & 1) == 1;
+				})
+			| fused::map([](int i) {
+			return i * 3;
+				})
+			| fused::flat_map([](int i) -> Generator<int> {
+			for (int j = 0; j < i; ++j)
+			{
+				co_yield j;
+			}
+				})
+			| fused::take(static_cast<std::size_t>(n))
+			| fused::for_each([&](int i) {
+			benchmark::DoNotOptimize(sum += i);
+				});
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Fused_ChainSpan)->Range(kMin, kMax);
+
+
+/// ---------- Prefetch ----------
+/// 上游几乎不花时间，测的是跨线程交接本身的开销，和 BM_Generator_Next 比较
+/// 缓冲区满了后台任务退出，消费到一半才重新调度，所以缓冲区越大调度次数越少
+static void BM_Generator_Prefetch(benchmark::State& state)
+{
+	const auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		long sum = 0;
+		auto range = Range(n);
+		auto gen = range.prefetch(1024, ThreadPoolExecutor::Shared());
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += gen.next());
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Prefetch)->Range(kMin, kMax)->UseRealTime();
+
+/// 上游和消费者各做一份 Work，不 prefetch 时两份在同一个线程上依次执行
+static void BM_Generator_Expensive(benchmark::State& state)
+{
+	const auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		std::uint64_t sum = 0;
+		auto gen = ExpensiveRange(n);
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += Work(gen.next()));
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_Expensive)->Range(kMin, kMax)->UseRealTime();
+
+/// prefetch 之后上游在后台线程上计算，和消费者的 Work 重叠，理想情况下耗时接近 BM_Generator_Expensive 的一半
+static void BM_Generator_PrefetchExpensive(benchmark::State& state)
+{
+	const auto n = static_cast<int>(state.range(0));
+	for (auto _ : state)
+	{
+		std::uint64_t sum = 0;
+		auto range = ExpensiveRange(n);
+		auto gen = range.prefetch(64, ThreadPoolExecutor::Shared());
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += Work(gen.next()));
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Generator_PrefetchExpensive)->Range(kMin, kMax)->UseRealTime();
+
+/// 只取前 16 个就销毁，测的是停止后台任务并等它退出的开销
+static void BM_Generator_PrefetchStopEarly(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		long sum = 0;
+		auto range = Range(kMax);
+		auto gen = range.prefetch(16, ThreadPoolExecutor::Shared());
+		for (int i = 0; i < 16 && gen.has_next(); ++i)
+		{
+			benchmark::DoNotOptimize(sum += gen.next());
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * 16);
+}
+BENCHMARK(BM_Generator_PrefetchStopEarly);
+
+/// ---------- Fibonacci ----------
+/// 每次都取 std::uint64_t 能表示的全部 94 项
+static void BM_Generator_Fibonacci(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		std::uint64_t sum = 0;
+		auto fibonacci = Fibonacci();
+		auto gen = fibonacci.take(static_cast<int>(Fibonacci64::kSize));
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += gen.next());
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * Fibonacci64::kSize);
+}
+BENCHMARK(BM_Generator_Fibonacci);
+
+static void BM_Table_Fibonacci(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		std::uint64_t sum = 0;
+		auto gen = fibonacci_table<std::uint64_t>();
+		while (gen.has_next())
+		{
+			benchmark::DoNotOptimize(sum += gen.next());
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * Fibonacci64::kSize);
+}
+BENCHMARK(BM_Table_Fibonacci);
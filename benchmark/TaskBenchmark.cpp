@@ -0,0 +1,198 @@
+#include <benchmark/benchmark.h>
+
+#include <coroutine>
+#include <functional>
+#include <vector>
+
+#include "coroutine/ZExample4/LazyTask.h"
+#include "coroutine/ZExample4/Task.h"
+
+/// Task<int> 的创建、等待、完成，以及 OnCompleted（Then）回调的派发
+/// 大部分用 NoopExecutor 在当前线程上执行，测的是 Task 本身的开销而不是线程切换
+/// 基线是做同样事情的普通函数调用
+
+namespace
+{
+	[[gnu::noinline]] int Add(int a, int b)
+	{
+		return a + b;
+	}
+
+	Task<int> Leaf([[maybe_unused]] AbstractExecutor& executor, int value)
+	{
+		co_return value;
+	}
+
+	Task<int> Parent(AbstractExecutor& executor, int value)
+	{
+		co_return co_await Leaf(executor, value) + 1;
+	}
+
+	LazyTask<int> LazyLeaf(int value)
+	{
+		co_return value;
+	}
+
+	LazyTask<int> LazyParent(int value)
+	{
+		co_return co_await LazyLeaf(value) + 1;
+	}
+
+	/// 把协程攒起来，由测试代码决定什么时候恢复，用来构造还没有完成的 Task
+	class ManualExecutor : public AbstractExecutor
+	{
+	public:
+		void Execute(std::function<void()>&& func) override
+		{
+			func();
+		}
+
+		void Schedule(std::coroutine_handle<> handle) override
+		{
+			m_vecHandles.push_back(handle);
+		}
+
+		void RunAll()
+		{
+			auto vecHandles = std::move(m_vecHandles);
+			m_vecHandles.clear();
+			for (auto handle : vecHandles)
+			{
+				handle.resume();
+			}
+		}
+
+	private:
+		std::vector<std::coroutine_handle<>> m_vecHandles;
+	};
+}
+
+/// ---------- Create / Complete ----------
+static void BM_DirectCall(benchmark::State& state)
+{
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = Add(value, 1));
+	}
+}
+BENCHMARK(BM_DirectCall);
+
+static void BM_Task_CreateComplete(benchmark::State& state)
+{
+	NoopExecutor executor;
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = Leaf(executor, value).GetResult());
+	}
+}
+BENCHMARK(BM_Task_CreateComplete);
+
+/// ---------- Await ----------
+static void BM_DirectCall_Nested(benchmark::State& state)
+{
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = Add(Add(value, 0), 1));
+	}
+}
+BENCHMARK(BM_DirectCall_Nested);
+
+/// 子 Task 创建时就已经完成了，co_await 不会挂起
+static void BM_Task_Await(benchmark::State& state)
+{
+	NoopExecutor executor;
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = Parent(executor, value).GetResult());
+	}
+}
+BENCHMARK(BM_Task_Await);
+
+/// LazyTask 在 co_await 时才开始，挂起等待方，对称转移到子 Task，完成后再转移回来
+static void BM_LazyTask_Await(benchmark::State& state)
+{
+	NoopExecutor executor;
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = LazyParent(value).ScheduleOn(executor).GetResult());
+	}
+}
+BENCHMARK(BM_LazyTask_Await);
+
+/// 交给全局线程池执行，再在当前线程上等待结果，包含两次线程切换
+static void BM_Task_ThreadPoolRoundTrip(benchmark::State& state)
+{
+	int value = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(value = Leaf(ThreadPoolExecutor::Shared(), value).GetResult());
+	}
+}
+BENCHMARK(BM_Task_ThreadPoolRoundTrip)->UseRealTime();
+
+/// ---------- OnCompleted ----------
+static void BM_FunctionCall(benchmark::State& state)
+{
+	int value = 0;
+	for (auto _ : state)
+	{
+		std::function<void(const int&)> func = [&value](const int& i) {
+			value += i;
+			};
+		func(1);
+		benchmark::DoNotOptimize(value);
+	}
+}
+BENCHMARK(BM_FunctionCall);
+
+/// Task 已经完成，Then 直接执行回调
+static void BM_Task_ThenCompleted(benchmark::State& state)
+{
+	NoopExecutor executor;
+	auto task = Leaf(executor, 1);
+	int value = 0;
+	for (auto _ : state)
+	{
+		task.Then([&value](const int& i) {
+			value += i;
+			});
+		benchmark::DoNotOptimize(value);
+	}
+}
+BENCHMARK(BM_Task_ThenCompleted);
+
+/// Task 还没有完成，回调先登记，Task 完成时由 Complete 派发
+/// 每次迭代包含一个 Task 的创建和完成，和 BM_Task_CreateComplete 对比
+static void BM_Task_ThenPending(benchmark::State& state)
+{
+	ManualExecutor executor;
+	int value = 0;
+	for (auto _ : state)
+	{
+		auto task = Leaf(executor, 1);
+		task.Then([&value](const int& i) {
+			value += i;
+			});
+		executor.RunAll();
+		benchmark::DoNotOptimize(value);
+	}
+}
+BENCHMARK(BM_Task_ThenPending);
+
+static void BM_Task_CreateCompletePending(benchmark::State& state)
+{
+	ManualExecutor executor;
+	int value = 0;
+	for (auto _ : state)
+	{
+		auto task = Leaf(executor, 1);
+		executor.RunAll();
+		benchmark::DoNotOptimize(value += task.GetResult());
+	}
+}
+BENCHMARK(BM_Task_CreateCompletePending);
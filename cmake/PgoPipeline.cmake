@@ -0,0 +1,55 @@
+# PGO 流程，由 pgo 目标通过 cmake -P 调用
+#	1. 用 CPPFEATURE_PGO=GENERATE 配置并构建插桩版本的 CppFeature_bench
+#	2. 运行基准，profile 写到 BINARY_DIR/pgo-profile
+#	3. 同一个构建目录改成 CPPFEATURE_PGO=USE，重新构建所有目标
+#	   只有 CppFeature_bench 的翻译单元有 profile，其余的目标（例如 ZExample4）照常构建，不会因此变快
+# GCC 按目标文件的路径查找 profile，所以两次构建必须在同一个目录里
+
+foreach(CPPFEATURE_VAR SOURCE_DIR BINARY_DIR CXX_COMPILER CXX_COMPILER_ID GENERATOR)
+    if(NOT DEFINED ${CPPFEATURE_VAR})
+        message(FATAL_ERROR "PgoPipeline.cmake: ${CPPFEATURE_VAR} is not set")
+    endif()
+endforeach()
+
+set(CPPFEATURE_PROFILE_DIR "${BINARY_DIR}/pgo-profile")
+set(CPPFEATURE_COMMON_ARGS
+    -S ${SOURCE_DIR}
+    -B ${BINARY_DIR}
+    -G ${GENERATOR}
+    -DCMAKE_BUILD_TYPE=Release
+    -DCMAKE_CXX_COMPILER=${CXX_COMPILER}
+    -DCPPFEATURE_PGO_DIR=${CPPFEATURE_PROFILE_DIR}
+    -DCPPFEATURE_CORO_INSTRUMENTATION=${INSTRUMENTATION}
+    -DCPPFEATURE_NATIVE=${NATIVE}
+    -DCPPFEATURE_SANITIZERS=
+)
+
+function(cppfeature_run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE CPPFEATURE_RESULT)
+    if(NOT CPPFEATURE_RESULT EQUAL 0)
+        list(JOIN ARGN " " CPPFEATURE_COMMAND)
+        message(FATAL_ERROR "PGO step failed (${CPPFEATURE_RESULT}): ${CPPFEATURE_COMMAND}")
+    endif()
+endfunction()
+
+# 上一次留下的 profile 会和这次的混在一起
+file(REMOVE_RECURSE ${CPPFEATURE_PROFILE_DIR})
+
+message(STATUS "PGO: building instrumented binaries")
+cppfeature_run(${CMAKE_COMMAND} ${CPPFEATURE_COMMON_ARGS} -DCPPFEATURE_PGO=GENERATE)
+cppfeature_run(${CMAKE_COMMAND} --build ${BINARY_DIR} --target CppFeature_bench)
+
+message(STATUS "PGO: collecting profile")
+separate_arguments(CPPFEATURE_TRAINING_ARGS NATIVE_COMMAND "${TRAINING_ARGS}")
+cppfeature_run(${BINARY_DIR}/CppFeature_bench ${CPPFEATURE_TRAINING_ARGS})
+
+if(CXX_COMPILER_ID MATCHES "Clang")
+    find_program(CPPFEATURE_LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+    file(GLOB CPPFEATURE_PROFRAW ${CPPFEATURE_PROFILE_DIR}/*.profraw)
+    cppfeature_run(${CPPFEATURE_LLVM_PROFDATA} merge -output=${CPPFEATURE_PROFILE_DIR}/default.profdata ${CPPFEATURE_PROFRAW})
+endif()
+
+message(STATUS "PGO: rebuilding with profile")
+cppfeature_run(${CMAKE_COMMAND} ${CPPFEATURE_COMMON_ARGS} -DCPPFEATURE_PGO=USE)
+cppfeature_run(${CMAKE_COMMAND} --build ${BINARY_DIR})
+message(STATUS "PGO: profile-optimized CppFeature_bench is ${BINARY_DIR}/CppFeature_bench")
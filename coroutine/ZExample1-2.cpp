@@ -1,6 +1,7 @@
 #include <coroutine>
 #include <iostream>
 #include <thread>
+#include <utility>
 
 /// 本例中，将 co_await 修改成 co_yield
 /// 需要修改的地方是将 await_transform 修改为 yield_value
@@ -6,6 +6,7 @@
 #include <initializer_list>
 #include <functional>
 #include <string>
+#include <utility>
 
 /// 本例中，我们来给Generator加上模板
 
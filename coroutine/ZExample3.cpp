@@ -7,6 +7,7 @@
 #include <iostream>
 #include <functional>
 #include <condition_variable>
+#include <utility>
 
 /// 本例中，我们定义一个类型 Task 来作为协程的返回值
 /// Task 类型可以用来封装任何返回结果的异步行为
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+#include "Cancellation.h"
+#include "Executor.h"
+#include "FrameAllocator.h"
+#include "Task.h"
+
+/// 异步 Generator
+/// Generator<T> 是同步的，Task<T> 只能返回一个值
+/// AsyncGenerator<T> 里既可以 co_await Task，也可以 co_yield 一个个的值
+///
+///		AsyncGenerator<Page> FetchPages(AbstractExecutor& executor)
+///		{
+///			while (...) { co_yield co_await FetchPage(...); }
+///		}
+///
+///		Task<int> Consume()
+///		{
+///			auto pages = FetchPages(executor);
+///			while (auto page = co_await pages.next()) { ... }
+///		}
+///
+/// 消费方取走一个值之后，生产方马上被交给调度器继续生产下一个
+/// 这样消费方处理当前值的同时，生产方已经在等下一个值的 I/O 了（预取一个）
+/// 和 TaskAwaiter 一样，双方都在自己的调度器上恢复：调度器相同时直接对称转移，不同时交给对方的调度器
+/// 例如生产方在 EventLoopExecutor 上等 I/O，消费方在线程池上处理，处理不会占用事件循环线程
+///
+/// 生产方和消费方之间用一个原子变量 m_pState 交接：
+///		nullptr				-> 生产方正在运行，消费方没有在等
+///		ReadyState()		-> 生产方挂起在 co_yield 或者 final_suspend，值已经准备好
+///		AbandonedState()	-> AsyncGenerator 已经析构，生产方下一次挂起时自己销毁
+///		其他					-> 消费方的协程句柄，消费方正在等下一个值
+
+template <typename T>
+class AsyncGenerator
+{
+public:
+	using value_type = std::remove_cvref_t<T>;
+
+	class promise_type : public PooledPromise
+	{
+	public:
+		promise_type() = default;
+
+		// 和 TaskPromise 一样，第一个参数是调度器时，生产方运行在这个调度器上
+		// 参数中的 std::stop_token 是生产方的取消 token
+		template <typename TFirst, typename ...TArgs>
+		explicit promise_type(TFirst& first, TArgs&... args)
+			: m_tokStop(FindStopToken(first, args...))
+		{
+			if constexpr (std::is_base_of_v<AbstractExecutor, TFirst> && !std::is_const_v<TFirst>)
+			{
+				m_pExecutor = &first;
+			}
+		}
+
+		AsyncGenerator get_return_object()
+		{
+			return AsyncGenerator{ std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+
+		// 第一次 co_await next() 时才开始执行
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		/// co_yield 和协程结束时都要把控制权交还给消费方
+		struct YieldAwaiter
+		{
+			bool await_ready() const noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+			{
+				return handle.promise().Publish(handle);
+			}
+			void await_resume() const noexcept {}
+		};
+
+		/// 和 Generator 一样，右值可以移动出去，左值是生产方自己的对象，只能复制
+		YieldAwaiter yield_value(const value_type& value)
+		{
+			m_pValue = std::addressof(value);
+			m_bRvalue = false;
+			return {};
+		}
+
+		YieldAwaiter yield_value(value_type&& value)
+		{
+			m_pValue = std::addressof(value);
+			m_bRvalue = true;
+			return {};
+		}
+
+		YieldAwaiter final_suspend() noexcept
+		{
+			m_pValue = nullptr;
+			return {};
+		}
+
+		void return_void() {}
+
+		void unhandled_exception()
+		{
+			m_pException = std::current_exception();
+		}
+
+		/// 生产方内部 co_await Task，子 Task 完成后回到生产方自己的调度器上恢复
+		template <typename R>
+		TaskAwaiter<R> await_transform(Task<R>&& task)
+		{
+			return TaskAwaiter<R>(m_pExecutor, std::move(task));
+		}
+
+		template <typename R>
+		TaskAwaiter<R> await_transform(LazyTask<R>&& task)
+		{
+			return TaskAwaiter<R>(m_pExecutor, m_tokStop, std::move(task));
+		}
+
+		template <typename TAwaiter>
+		TAwaiter&& await_transform(TAwaiter&& awaiter)
+		{
+			return std::forward<TAwaiter>(awaiter);
+		}
+
+		AbstractExecutor* GetExecutor() const
+		{
+			return m_pExecutor;
+		}
+
+		const std::stop_token& GetStopToken() const
+		{
+			return m_tokStop;
+		}
+
+	private:
+		friend class AsyncGenerator;
+
+		void* ReadyState() const
+		{
+			return const_cast<promise_type*>(this);
+		}
+
+		void* AbandonedState() const
+		{
+			return const_cast<const value_type**>(&m_pValue);
+		}
+
+		// 值已经准备好了，有消费方在等就让它恢复
+		// 消费方和生产方在同一个调度器上（或者消费方没有调度器）时直接转移过去，否则交给消费方的调度器
+		std::coroutine_handle<> Publish(std::coroutine_handle<promise_type> handle) noexcept
+		{
+			auto pState = m_pState.exchange(ReadyState(), std::memory_order_acq_rel);
+			if (pState == nullptr)
+			{
+				return std::noop_coroutine();
+			}
+			if (pState == AbandonedState())
+			{
+				// 协程已经挂起了，可以在这里销毁自己，之后不能再访问成员
+				handle.destroy();
+				return std::noop_coroutine();
+			}
+			auto hConsumer = std::coroutine_handle<>::from_address(pState);
+			auto pConsumerExecutor = m_pConsumerExecutor;
+			if (pConsumerExecutor == nullptr || pConsumerExecutor == m_pExecutor)
+			{
+				return hConsumer;
+			}
+			pConsumerExecutor->Schedule(hConsumer);
+			return std::noop_coroutine();
+		}
+
+	private:
+		AbstractExecutor* m_pExecutor = &ThreadPoolExecutor::Shared();
+		std::stop_token m_tokStop{};
+
+		std::atomic<void*> m_pState{ nullptr };
+		bool m_bStarted = false;
+		// 正在等待的消费方的调度器，在 m_pState 发布消费方句柄之前写入
+		AbstractExecutor* m_pConsumerExecutor = nullptr;
+
+		// 指向 co_yield 的值，生产方挂起期间一直有效
+		const value_type* m_pValue = nullptr;
+		// co_yield 的是不是右值
+		bool m_bRvalue = false;
+		std::exception_ptr m_pException{};
+	};
+
+	/// co_await next() 的 Awaiter
+	/// 生产方结束后返回 std::nullopt
+	class NextAwaiter
+	{
+	public:
+		explicit NextAwaiter(std::coroutine_handle<promise_type> handle) noexcept
+			: m_coroHandle(handle) {};
+
+		bool await_ready() const noexcept
+		{
+			auto& promise = m_coroHandle.promise();
+			return promise.m_bStarted
+				&& promise.m_pState.load(std::memory_order_acquire) == promise.ReadyState();
+		}
+
+		template <typename TPromise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+		{
+			auto& promise = m_coroHandle.promise();
+			AbstractExecutor* pExecutor = nullptr;
+			if constexpr (requires { handle.promise().GetExecutor(); })
+			{
+				pExecutor = handle.promise().GetExecutor();
+			}
+			promise.m_pConsumerExecutor = pExecutor;
+			if (!promise.m_bStarted)
+			{
+				// 第一次取值，调度器相同时直接转移到生产方开始执行，否则在生产方自己的调度器上开始
+				promise.m_bStarted = true;
+				promise.m_pState.store(handle.address(), std::memory_order_release);
+				if (pExecutor == nullptr || pExecutor == promise.m_pExecutor)
+				{
+					return m_coroHandle;
+				}
+				promise.m_pExecutor->Schedule(m_coroHandle);
+				return std::noop_coroutine();
+			}
+			void* pExpected = nullptr;
+			if (promise.m_pState.compare_exchange_strong(pExpected, handle.address(),
+				std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				// 生产方还在运行，等它 co_yield 时转移回来
+				return std::noop_coroutine();
+			}
+			// 生产方刚好准备好了
+			return handle;
+		}
+
+		std::optional<value_type> await_resume()
+		{
+			auto& promise = m_coroHandle.promise();
+			if (m_coroHandle.done())
+			{
+				if (promise.m_pException)
+				{
+					std::rethrow_exception(promise.m_pException);
+				}
+				return std::nullopt;
+			}
+			// 生产方这时挂起在 co_yield 上，先把值取出来（右值移动，左值复制），再让它继续生产下一个
+			std::optional<value_type> value = promise.m_bRvalue
+				? std::optional<value_type>(std::move(*const_cast<value_type*>(promise.m_pValue)))
+				: std::optional<value_type>(*promise.m_pValue);
+			promise.m_pState.store(nullptr, std::memory_order_release);
+			promise.m_pExecutor->Schedule(m_coroHandle);
+			return value;
+		}
+
+	private:
+		std::coroutine_handle<promise_type> m_coroHandle;
+	};
+
+	NextAwaiter next()
+	{
+		return NextAwaiter{ m_coroHandle };
+	}
+
+	explicit AsyncGenerator(std::coroutine_handle<promise_type> handle) noexcept
+		: m_coroHandle(handle) {};
+
+	AsyncGenerator(AsyncGenerator&& generator) noexcept
+		: m_coroHandle(std::exchange(generator.m_coroHandle, {})) {};
+
+	AsyncGenerator(AsyncGenerator&) = delete;
+	AsyncGenerator& operator=(AsyncGenerator&) = delete;
+
+	~AsyncGenerator()
+	{
+		if (!m_coroHandle)
+		{
+			return;
+		}
+		// 生产方可能正在预取下一个值，这时不能销毁，也不能阻塞等它（它可能和我们在同一个线程上排队）
+		// 标记为放弃，由生产方在下一次挂起时销毁自己
+		auto& promise = m_coroHandle.promise();
+		if (promise.m_bStarted)
+		{
+			void* pExpected = nullptr;
+			if (promise.m_pState.compare_exchange_strong(pExpected, promise.AbandonedState(),
+				std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				return;
+			}
+		}
+		m_coroHandle.destroy();
+	}
+
+private:
+	std::coroutine_handle<promise_type> m_coroHandle{};
+};
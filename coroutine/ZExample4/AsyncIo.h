@@ -0,0 +1,183 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <system_error>
+#include <type_traits>
+
+#include <sys/socket.h>
+
+#include "Cancellation.h"
+#include "EventLoopExecutor.h"
+
+/// I/O Awaiter
+/// 在 await_suspend 中把请求交给事件循环，完成后协程回到 promise 的调度器上恢复
+/// promise 没有提供 GetExecutor() 时在事件循环线程上恢复
+/// 系统调用失败时 await_resume 抛出 std::system_error
+/// promise 提供了 GetStopToken() 时可以被取消，取消后 await_resume 抛出 OperationCancelled
+///
+///		Task<int> Echo(EventLoopExecutor& loop, int fd)
+///		{
+///			std::byte buffer[4096];
+///			auto n = co_await AsyncRead(loop, fd, buffer);
+///			co_await AsyncWrite(loop, fd, std::span(buffer, n));
+///			co_return 0;
+///		}
+
+template <typename TResult>
+class IoAwaiter
+{
+public:
+	IoAwaiter(EventLoopExecutor& loop, const IoOperation& operation) noexcept
+		: m_pLoop(&loop), m_Operation(operation) {};
+
+	// 协程框架可能会在挂起之前复制 Awaiter，这时还没有登记取消回调
+	IoAwaiter(const IoAwaiter& awaiter) noexcept
+		: m_pLoop(awaiter.m_pLoop), m_Operation(awaiter.m_Operation) {};
+
+	IoAwaiter& operator=(const IoAwaiter&) = delete;
+
+	bool await_ready() const noexcept { return false; }
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle)
+	{
+		m_Operation.m_hCoroutine = handle;
+		if constexpr (requires { handle.promise().GetExecutor(); })
+		{
+			m_Operation.m_pExecutor = handle.promise().GetExecutor();
+		}
+		auto token = GetStopToken(handle);
+		if (token.stop_possible())
+		{
+			if (token.stop_requested())
+			{
+				m_Operation.m_nResult = -ECANCELED;
+				return false;
+			}
+			// 回调只记录请求的地址和编号，真正的取消在事件循环线程上确认过之后才执行
+			m_Operation.m_tokStop = token;
+			m_Operation.m_nCancelId = m_pLoop->NextCancelId();
+			m_optCallback.emplace(std::move(token), CancelCallback{ m_pLoop, &m_Operation, m_Operation.m_nCancelId });
+		}
+		// 提交之后协程随时可能在别的线程上恢复，不能再访问成员
+		m_pLoop->Submit(&m_Operation);
+		return true;
+	}
+
+	TResult await_resume() const
+	{
+		if (m_Operation.m_nResult == -ECANCELED)
+		{
+			throw OperationCancelled();
+		}
+		if (m_Operation.m_nResult < 0)
+		{
+			throw std::system_error(-m_Operation.m_nResult, std::system_category());
+		}
+		if constexpr (!std::is_void_v<TResult>)
+		{
+			return static_cast<TResult>(m_Operation.m_nResult);
+		}
+	}
+
+private:
+	struct CancelCallback
+	{
+		EventLoopExecutor* m_pLoop;
+		IoOperation* m_pOperation;
+		std::uint64_t m_nCancelId;
+
+		void operator()() const
+		{
+			m_pLoop->Cancel(m_pOperation, m_nCancelId);
+		}
+	};
+
+private:
+	EventLoopExecutor* m_pLoop;
+	IoOperation m_Operation;
+	// 析构时从 token 上注销，回调正在别的线程上执行时会等它结束
+	std::optional<std::stop_callback<CancelCallback>> m_optCallback;
+};
+
+/// 读取数据，返回读到的字节数，0 表示对端已经关闭
+inline IoAwaiter<std::size_t> AsyncRead(EventLoopExecutor& loop, int nFd, std::span<std::byte> buffer, std::int64_t nOffset = -1)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::Read;
+	operation.m_nFd = nFd;
+	operation.m_pBuffer = buffer.data();
+	operation.m_nLength = buffer.size();
+	operation.m_nOffset = nOffset;
+	return { loop, operation };
+}
+
+/// 写入数据，返回写入的字节数，可能少于 buffer 的长度
+inline IoAwaiter<std::size_t> AsyncWrite(EventLoopExecutor& loop, int nFd, std::span<const std::byte> buffer, std::int64_t nOffset = -1)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::Write;
+	operation.m_nFd = nFd;
+	operation.m_pBuffer = const_cast<std::byte*>(buffer.data());
+	operation.m_nLength = buffer.size();
+	operation.m_nOffset = nOffset;
+	return { loop, operation };
+}
+
+/// 使用 RegisterBuffers 注册过的第 nBufferIndex 个缓冲区，buffer 必须落在这个缓冲区里
+/// io_uring 不需要再为这次请求映射用户内存，epoll 后端按普通的读写执行
+inline IoAwaiter<std::size_t> AsyncReadFixed(EventLoopExecutor& loop, int nFd, int nBufferIndex, std::span<std::byte> buffer, std::int64_t nOffset = -1)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::ReadFixed;
+	operation.m_nFd = nFd;
+	operation.m_nBufferIndex = nBufferIndex;
+	operation.m_pBuffer = buffer.data();
+	operation.m_nLength = buffer.size();
+	operation.m_nOffset = nOffset;
+	return { loop, operation };
+}
+
+inline IoAwaiter<std::size_t> AsyncWriteFixed(EventLoopExecutor& loop, int nFd, int nBufferIndex, std::span<const std::byte> buffer, std::int64_t nOffset = -1)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::WriteFixed;
+	operation.m_nFd = nFd;
+	operation.m_nBufferIndex = nBufferIndex;
+	operation.m_pBuffer = const_cast<std::byte*>(buffer.data());
+	operation.m_nLength = buffer.size();
+	operation.m_nOffset = nOffset;
+	return { loop, operation };
+}
+
+/// 接受一个连接，返回新的文件描述符，pAddress 不为空时写入对端地址
+inline IoAwaiter<int> AsyncAccept(EventLoopExecutor& loop, int nListenFd, sockaddr* pAddress = nullptr, socklen_t nAddressLength = 0)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::Accept;
+	operation.m_nFd = nListenFd;
+	operation.m_pAddress = pAddress;
+	operation.m_nAddressLength = nAddressLength;
+	return { loop, operation };
+}
+
+/// 发起连接，地址在连接完成之前必须保持有效
+inline IoAwaiter<void> AsyncConnect(EventLoopExecutor& loop, int nFd, const sockaddr* pAddress, socklen_t nAddressLength)
+{
+	IoOperation operation;
+	operation.m_eType = IoOperation::Type::Connect;
+	operation.m_nFd = nFd;
+	operation.m_pAddress = const_cast<sockaddr*>(pAddress);
+	operation.m_nAddressLength = nAddressLength;
+	return { loop, operation };
+}
+
+#endif
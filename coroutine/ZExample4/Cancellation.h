@@ -0,0 +1,88 @@
+#pragma once
+
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+/// 协作式取消
+/// 调用方持有 std::stop_source，把 token 作为协程的参数传进去：
+///		Task<int> Download(std::stop_token token, ...)
+/// token 保存在 promise 里，在协程开始执行之前就确定下来，之后不再修改，读取时不需要同步
+///		1. co_await 一个还没有开始的 LazyTask 时，子 Task 没有自己的 token 就继承等待方的
+///		2. Generator 的 map/filter 等成员函数以上游的 Generator 为第一个参数，创建时继承上游的 token
+///		3. 普通的 Task 创建时就已经开始执行了，等到被 co_await 时再继承就晚了，需要显式传参
+/// 定时器和 I/O 的 Awaiter 会从 promise 中取出 token：
+///		挂起之前已经请求取消时不挂起，挂起之后请求取消时提前恢复，都在 await_resume 中抛出 OperationCancelled
+/// 计算型的协程可以 co_await CurrentStopToken() 取得自己的 token，自行决定在哪里检查
+
+class OperationCancelled : public std::exception
+{
+public:
+	const char* what() const noexcept override
+	{
+		return "operation cancelled";
+	}
+};
+
+/// 协程参数中第一个可以被取消的 std::stop_token，找不到时返回空的 token（永远不会被取消）
+template <typename ...TArgs>
+std::stop_token FindStopToken(TArgs&... args)
+{
+	std::stop_token token;
+	([&](auto& arg) {
+		if constexpr (std::is_same_v<std::remove_cvref_t<decltype(arg)>, std::stop_token>)
+		{
+			if (!token.stop_possible())
+			{
+				token = arg;
+			}
+		}
+		}(args), ...);
+	return token;
+}
+
+/// 取得协程 promise 中的 token，promise 不支持取消时返回空的 token
+template <typename TPromise>
+std::stop_token GetStopToken(std::coroutine_handle<TPromise> handle)
+{
+	if constexpr (requires { { handle.promise().GetStopToken() } -> std::convertible_to<std::stop_token>; })
+	{
+		return handle.promise().GetStopToken();
+	}
+	else
+	{
+		return {};
+	}
+}
+
+/// co_await CurrentStopToken() 取得当前协程的 token，不会真正挂起
+///		auto token = co_await CurrentStopToken();
+///		while (!token.stop_requested()) { ... }
+class CurrentStopTokenAwaiter
+{
+public:
+	bool await_ready() const noexcept { return false; }
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		m_tokStop = GetStopToken(handle);
+		return false;
+	}
+
+	std::stop_token await_resume() noexcept
+	{
+		return std::move(m_tokStop);
+	}
+
+private:
+	std::stop_token m_tokStop;
+};
+
+inline CurrentStopTokenAwaiter CurrentStopToken() noexcept
+{
+	return {};
+}
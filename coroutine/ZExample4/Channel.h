@@ -0,0 +1,652 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "Cancellation.h"
+#include "Executor.h"
+
+/// 通道
+/// Generator 只能在一个线程上拉取，Task 只有一个结果，想在不同线程上的协程之间传递一串值就需要通道
+/// Channel<T> 是有界的多生产者多消费者队列：
+///		Task<void> Producer(Channel<int>& channel)
+///		{
+///			for (int i = 0; i < 100; ++i)
+///			{
+///				co_await channel.Send(i);
+///			}
+///			channel.Close();
+///		}
+///
+///		Task<void> Consumer(Channel<int>& channel)
+///		{
+///			while (auto value = co_await channel.Recv())
+///			{
+///				...
+///			}
+///		}
+/// 队列满时 Send 挂起，队列空时 Recv 挂起，由对方腾出位置（或者放入元素）后交给等待方自己的调度器恢复
+/// 这样生产者不会比消费者快太多，内存占用就是容量那么多
+///
+/// 数据放在无锁的环形缓冲区里，不需要等待时收发都不加锁
+/// 只有挂起的协程需要登记到等待链表上，这部分由一把锁保护
+/// 收发成功后检查一下有没有等待者，没有就直接返回，所以没有等待者时每条消息只有几次原子操作
+
+/// ---------- Bounded MPMC Queue ----------
+/// 参考 Dmitry Vyukov 的 Bounded MPMC Queue
+/// 每个槽位带一个序号，生产者和消费者各自用 CAS 抢占位置，抢到之后通过序号交接槽位
+///		序号 == 位置		槽位是空的，可以写入
+///		序号 == 位置 + 1	槽位里有数据，可以读取
+/// 读取之后序号加上容量，留给下一圈的生产者
+/// 关闭时在入队位置上置一个关闭位，之后的 TryPush 都会失败
+/// 入队位置的修改是全序的，所以关闭之前抢到位置的元素和关闭之后被拒绝的元素有明确的分界
+template <typename T>
+class BoundedQueue
+{
+	struct Slot
+	{
+		std::atomic<std::size_t> m_nSequence;
+		alignas(T) unsigned char m_Storage[sizeof(T)];
+
+		T* Value() noexcept
+		{
+			return std::launder(reinterpret_cast<T*>(m_Storage));
+		}
+	};
+
+public:
+	// 容量向上取到 2 的幂，至少为 2（只有一个槽位时序号无法区分空和满）
+	explicit BoundedQueue(std::size_t nCapacity)
+		: m_nMask(RoundUp(nCapacity) - 1), m_pSlots(new Slot[m_nMask + 1])
+	{
+		for (std::size_t i = 0; i <= m_nMask; ++i)
+		{
+			m_pSlots[i].m_nSequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~BoundedQueue()
+	{
+		std::optional<T> optValue;
+		while (TryPop(optValue))
+		{
+			optValue.reset();
+		}
+	}
+
+	BoundedQueue(BoundedQueue&) = delete;
+	BoundedQueue& operator=(BoundedQueue&) = delete;
+
+	std::size_t Capacity() const noexcept
+	{
+		return m_nMask + 1;
+	}
+
+	// 成功时从 value 中移走，队列满或者已经关闭时 value 保持不变
+	bool TryPush(T& value)
+	{
+		auto nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			// 关闭位也参与 CAS 的比较，关闭之后不会再有生产者抢到位置
+			if (nPos & kClosedBit)
+			{
+				return false;
+			}
+			auto& slot = m_pSlots[nPos & m_nMask];
+			auto nSequence = slot.m_nSequence.load(std::memory_order_acquire);
+			auto nDiff = static_cast<std::ptrdiff_t>(nSequence) - static_cast<std::ptrdiff_t>(nPos);
+			if (nDiff == 0)
+			{
+				if (m_nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+				{
+					// 抢到了位置，序号没有更新之前消费者不会读这个槽位
+					::new (static_cast<void*>(slot.m_Storage)) T(std::move(value));
+					slot.m_nSequence.store(nPos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (nDiff < 0)
+			{
+				// 上一圈的数据还没有被取走，队列满了
+				return false;
+			}
+			else
+			{
+				// 被别的生产者抢先了
+				nPos = m_nEnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// 成功时把元素放进 optValue，队列空时 optValue 保持不变
+	bool TryPop(std::optional<T>& optValue)
+	{
+		auto nPos = m_nDequeuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			auto& slot = m_pSlots[nPos & m_nMask];
+			auto nSequence = slot.m_nSequence.load(std::memory_order_acquire);
+			auto nDiff = static_cast<std::ptrdiff_t>(nSequence) - static_cast<std::ptrdiff_t>(nPos + 1);
+			if (nDiff == 0)
+			{
+				if (m_nDequeuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+				{
+					optValue.emplace(std::move(*slot.Value()));
+					slot.Value()->~T();
+					slot.m_nSequence.store(nPos + m_nMask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (nDiff < 0)
+			{
+				// 生产者还没有写入，队列空了
+				return false;
+			}
+			else
+			{
+				nPos = m_nDequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// 关闭之后 TryPush 都返回 false，已经抢到位置的生产者不受影响
+	void Close() noexcept
+	{
+		m_nEnqueuePos.fetch_or(kClosedBit, std::memory_order_acq_rel);
+	}
+
+	bool IsClosed() const noexcept
+	{
+		return (m_nEnqueuePos.load(std::memory_order_acquire) & kClosedBit) != 0;
+	}
+
+	// 只能在 IsClosed() 之后调用
+	// TryPop 在生产者抢到位置但还没有写完时也会失败，这时等它写完再取
+	// 返回 false 表示关闭之前放进来的元素都已经被取走了
+	bool TryPopClosed(std::optional<T>& optValue)
+	{
+		while (!TryPop(optValue))
+		{
+			auto nEnd = m_nEnqueuePos.load(std::memory_order_acquire) & ~kClosedBit;
+			if (m_nDequeuePos.load(std::memory_order_relaxed) >= nEnd)
+			{
+				return false;
+			}
+			// 写入只有一次移动构造，很快就能完成
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+private:
+	static constexpr std::size_t kClosedBit = std::size_t{ 1 } << (sizeof(std::size_t) * 8 - 1);
+
+	static std::size_t RoundUp(std::size_t nCapacity) noexcept
+	{
+		std::size_t nResult = 2;
+		while (nResult < nCapacity)
+		{
+			nResult <<= 1;
+		}
+		return nResult;
+	}
+
+private:
+	const std::size_t m_nMask;
+	std::unique_ptr<Slot[]> m_pSlots;
+
+	// 生产者和消费者各自修改自己的位置，分开放在不同的缓存行上
+	alignas(64) std::atomic<std::size_t> m_nEnqueuePos{ 0 };
+	alignas(64) std::atomic<std::size_t> m_nDequeuePos{ 0 };
+};
+
+
+/// ---------- Channel ----------
+/// Send/Recv 返回的 Awaiter 可以被取消：promise 提供了 GetStopToken() 时，挂起期间请求取消会提前恢复并抛出 OperationCancelled
+/// 关闭之后 Send 返回 false，Recv 取完剩下的元素后返回 std::nullopt
+/// 和 Close 同时进行的 Send 可能成功也可能失败，但是返回 true 的元素一定能被 Recv 取到：
+/// Close 在队列的入队位置上置关闭位，Recv 在关闭之后要取到关闭前抢到的最后一个位置才会返回 std::nullopt
+template <typename T>
+class Channel
+{
+	/// 挂起的协程，放在 Awaiter 里，不需要额外分配
+	/// 和 SleepAwaiter 一样用一个计数为 2 的门闩：
+	/// 配对（关闭、取消）的一方和 await_suspend 各释放一个，最后释放的一方负责恢复协程
+	struct Waiter;
+
+	struct CancelCallback
+	{
+		Channel* m_pChannel;
+		Waiter* m_pWaiter;
+
+		void operator()() const noexcept
+		{
+			m_pChannel->Cancel(m_pWaiter);
+		}
+	};
+
+	enum class WaitState
+	{
+		Pending,
+		Completed,
+		Closed,
+		Cancelled,
+	};
+
+	struct Waiter
+	{
+		Waiter* m_pPrev = nullptr;
+		Waiter* m_pNext = nullptr;
+		// 所在的等待链表，为空表示不在任何链表上
+		Waiter** m_ppHead = nullptr;
+
+		std::coroutine_handle<> m_hCoroutine{};
+		AbstractExecutor* m_pExecutor = nullptr;
+		std::atomic<int> m_nGate{ 2 };
+		WaitState m_eState = WaitState::Pending;
+		// Send 要发送的值，或者 Recv 收到的值
+		std::optional<T> m_optValue{};
+		// 析构时从 token 上注销，回调正在别的线程上执行时会等它结束
+		std::optional<std::stop_callback<CancelCallback>> m_optCallback{};
+
+		void Release() noexcept
+		{
+			if (m_nGate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				// 恢复之后 Awaiter 随时可能被销毁，不能再访问成员
+				m_pExecutor->Schedule(m_hCoroutine);
+			}
+		}
+	};
+
+	/// 先进先出的侵入式双向链表，只在持有锁时访问
+	class WaitList
+	{
+	public:
+		bool Empty() const noexcept { return m_pHead == nullptr; }
+
+		Waiter* Front() const noexcept { return m_pHead; }
+
+		void PushBack(Waiter* pWaiter) noexcept
+		{
+			pWaiter->m_pPrev = m_pTail;
+			pWaiter->m_pNext = nullptr;
+			pWaiter->m_ppHead = &m_pHead;
+			if (m_pTail != nullptr)
+			{
+				m_pTail->m_pNext = pWaiter;
+			}
+			else
+			{
+				m_pHead = pWaiter;
+			}
+			m_pTail = pWaiter;
+		}
+
+		Waiter* PopFront() noexcept
+		{
+			auto pWaiter = m_pHead;
+			Remove(pWaiter);
+			return pWaiter;
+		}
+
+		void Remove(Waiter* pWaiter) noexcept
+		{
+			(pWaiter->m_pPrev != nullptr ? pWaiter->m_pPrev->m_pNext : m_pHead) = pWaiter->m_pNext;
+			(pWaiter->m_pNext != nullptr ? pWaiter->m_pNext->m_pPrev : m_pTail) = pWaiter->m_pPrev;
+			pWaiter->m_pPrev = pWaiter->m_pNext = nullptr;
+			pWaiter->m_ppHead = nullptr;
+		}
+
+		bool Contains(const Waiter* pWaiter) const noexcept
+		{
+			return pWaiter->m_ppHead == &m_pHead;
+		}
+
+	private:
+		Waiter* m_pHead = nullptr;
+		Waiter* m_pTail = nullptr;
+	};
+
+	template <bool bSend>
+	class ChannelAwaiter
+	{
+	public:
+		explicit ChannelAwaiter(Channel* pChannel) noexcept
+			: m_pChannel(pChannel) {};
+
+		ChannelAwaiter(Channel* pChannel, T&& value)
+			: m_pChannel(pChannel)
+		{
+			m_Waiter.m_optValue.emplace(std::move(value));
+		}
+
+		// 协程框架可能会在挂起之前移动 Awaiter，这时还没有登记任何东西
+		ChannelAwaiter(ChannelAwaiter&& awaiter) noexcept(std::is_nothrow_move_constructible_v<T>)
+			: m_pChannel(awaiter.m_pChannel)
+		{
+			m_Waiter.m_optValue = std::move(awaiter.m_Waiter.m_optValue);
+		}
+
+		ChannelAwaiter& operator=(ChannelAwaiter&) = delete;
+
+		bool await_ready()
+		{
+			return m_pChannel->template TryComplete<bSend>(m_Waiter);
+		}
+
+		template <typename TPromise>
+		bool await_suspend(std::coroutine_handle<TPromise> handle)
+		{
+			AbstractExecutor* pExecutor = nullptr;
+			if constexpr (requires { handle.promise().GetExecutor(); })
+			{
+				pExecutor = handle.promise().GetExecutor();
+			}
+			m_Waiter.m_hCoroutine = handle;
+			m_Waiter.m_pExecutor = pExecutor != nullptr ? pExecutor : &s_InlineExecutor;
+			return m_pChannel->template Suspend<bSend>(m_Waiter, GetStopToken(handle));
+		}
+
+		auto await_resume()
+		{
+			if (m_Waiter.m_eState == WaitState::Cancelled)
+			{
+				throw OperationCancelled();
+			}
+			if constexpr (bSend)
+			{
+				return m_Waiter.m_eState == WaitState::Completed;
+			}
+			else
+			{
+				return std::move(m_Waiter.m_optValue);
+			}
+		}
+
+	private:
+		Channel* m_pChannel;
+		Waiter m_Waiter{};
+	};
+
+public:
+	// co_await 之后返回 bool，false 表示通道已经关闭，值没有发送出去
+	using SendAwaiter = ChannelAwaiter<true>;
+	// co_await 之后返回 std::optional<T>，std::nullopt 表示通道已经关闭并且取完了
+	using RecvAwaiter = ChannelAwaiter<false>;
+
+	explicit Channel(std::size_t nCapacity)
+		: m_Queue(nCapacity) {};
+
+	Channel(Channel&) = delete;
+	Channel& operator=(Channel&) = delete;
+
+	std::size_t Capacity() const noexcept
+	{
+		return m_Queue.Capacity();
+	}
+
+	SendAwaiter Send(T value)
+	{
+		return SendAwaiter(this, std::move(value));
+	}
+
+	RecvAwaiter Recv() noexcept
+	{
+		return RecvAwaiter(this);
+	}
+
+	// 不挂起的版本，通道满了或者已经关闭时返回 false，value 保持不变
+	bool TrySend(T& value)
+	{
+		if (m_bClosed.load(std::memory_order_acquire) || !m_Queue.TryPush(value))
+		{
+			return false;
+		}
+		Notify();
+		return true;
+	}
+
+	std::optional<T> TryRecv()
+	{
+		std::optional<T> optValue;
+		if (m_Queue.TryPop(optValue))
+		{
+			Notify();
+		}
+		return optValue;
+	}
+
+	// 关闭通道，唤醒所有等待者，重复关闭没有影响
+	void Close()
+	{
+		WaitList listWoken;
+		{
+			std::lock_guard lock(m_lMutex);
+			if (m_bClosed.exchange(true, std::memory_order_acq_rel))
+			{
+				return;
+			}
+			// 还能配对的先配对，剩下的等待者都不会再有机会了
+			Drain(listWoken);
+			// 从这里开始不加锁的 Send 也放不进队列了
+			m_Queue.Close();
+			for (auto pList : { &m_listSenders, &m_listReceivers })
+			{
+				while (!pList->Empty())
+				{
+					auto pWaiter = pList->PopFront();
+					pWaiter->m_eState = WaitState::Closed;
+					listWoken.PushBack(pWaiter);
+					m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		ReleaseAll(listWoken);
+	}
+
+	bool IsClosed() const noexcept
+	{
+		return m_bClosed.load(std::memory_order_acquire);
+	}
+
+private:
+	// 不挂起地尝试一次，返回 true 表示已经有了结果
+	template <bool bSend>
+	bool TryComplete(Waiter& waiter)
+	{
+		if constexpr (bSend)
+		{
+			if (m_bClosed.load(std::memory_order_acquire))
+			{
+				waiter.m_eState = WaitState::Closed;
+				return true;
+			}
+			if (!m_Queue.TryPush(*waiter.m_optValue))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			if (!m_Queue.TryPop(waiter.m_optValue))
+			{
+				// 以队列的关闭位为准：Close 还没有执行到 m_Queue.Close() 时仍然可能有新的元素
+				if (!m_Queue.IsClosed())
+				{
+					return false;
+				}
+				// 关闭之前抢到位置的元素可能还没有写完，要等它写完
+				if (!m_Queue.TryPopClosed(waiter.m_optValue))
+				{
+					waiter.m_eState = WaitState::Closed;
+					return true;
+				}
+			}
+		}
+		waiter.m_eState = WaitState::Completed;
+		Notify();
+		return true;
+	}
+
+	// 返回 true 表示需要挂起
+	template <bool bSend>
+	bool Suspend(Waiter& waiter, const std::stop_token& token)
+	{
+		bool bSuspend = false;
+		{
+			std::lock_guard lock(m_lMutex);
+			// 先登记再重试：和收发之后检查等待者的一方构成 Dekker 式的同步
+			// 两边都有 seq_cst 栅栏，所以要么这里重试成功，要么对方看到了等待者
+			m_nWaiters.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (token.stop_requested())
+			{
+				waiter.m_eState = WaitState::Cancelled;
+			}
+			else if (!TryCompleteLocked<bSend>(waiter))
+			{
+				(bSend ? m_listSenders : m_listReceivers).PushBack(&waiter);
+				bSuspend = true;
+			}
+			if (!bSuspend)
+			{
+				m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (!bSuspend)
+		{
+			// 锁外再唤醒对方
+			if (waiter.m_eState == WaitState::Completed)
+			{
+				Notify();
+			}
+			return false;
+		}
+		if (token.stop_possible())
+		{
+			// 已经请求过取消时回调会在这里直接执行
+			waiter.m_optCallback.emplace(token, CancelCallback{ this, &waiter });
+		}
+		return waiter.m_nGate.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	// 持有锁时的重试，和 TryComplete 一样但不唤醒对方
+	template <bool bSend>
+	bool TryCompleteLocked(Waiter& waiter)
+	{
+		// Close 持有锁时才会修改，这里看到关闭时队列也一定已经关闭了
+		if (m_bClosed.load(std::memory_order_relaxed))
+		{
+			if (bSend || !m_Queue.TryPopClosed(waiter.m_optValue))
+			{
+				waiter.m_eState = WaitState::Closed;
+				return true;
+			}
+		}
+		else if (bSend ? !m_Queue.TryPush(*waiter.m_optValue) : !m_Queue.TryPop(waiter.m_optValue))
+		{
+			return false;
+		}
+		waiter.m_eState = WaitState::Completed;
+		return true;
+	}
+
+	void Cancel(Waiter* pWaiter) noexcept
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			// 已经配对成功（或者被关闭）时从链表上摘下来了，由那一方释放
+			auto pList = m_listSenders.Contains(pWaiter) ? &m_listSenders
+				: m_listReceivers.Contains(pWaiter) ? &m_listReceivers : nullptr;
+			if (pList == nullptr)
+			{
+				return;
+			}
+			pList->Remove(pWaiter);
+			pWaiter->m_eState = WaitState::Cancelled;
+			m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+		pWaiter->Release();
+	}
+
+	// 收发成功之后调用，有等待者时把能配对的都配对掉
+	void Notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_nWaiters.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+		WaitList listWoken;
+		{
+			std::lock_guard lock(m_lMutex);
+			Drain(listWoken);
+		}
+		ReleaseAll(listWoken);
+	}
+
+	// 持有锁时调用
+	// 给等待的接收方取一个元素会腾出一个位置，给等待的发送方放一个元素又会多出一个元素，所以交替进行直到都不能再配对
+	void Drain(WaitList& listWoken)
+	{
+		bool bProgress = true;
+		while (bProgress)
+		{
+			bProgress = false;
+			while (!m_listReceivers.Empty() && m_Queue.TryPop(m_listReceivers.Front()->m_optValue))
+			{
+				Wake(m_listReceivers, listWoken);
+				bProgress = true;
+			}
+			while (!m_listSenders.Empty() && m_Queue.TryPush(*m_listSenders.Front()->m_optValue))
+			{
+				Wake(m_listSenders, listWoken);
+				bProgress = true;
+			}
+		}
+	}
+
+	void Wake(WaitList& list, WaitList& listWoken) noexcept
+	{
+		auto pWaiter = list.PopFront();
+		pWaiter->m_eState = WaitState::Completed;
+		listWoken.PushBack(pWaiter);
+		m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// 锁外恢复，释放之后节点可能已经被销毁了，要先取出下一个
+	// 这时节点已经不在通道的链表上了，取消回调不会再修改它
+	static void ReleaseAll(WaitList& listWoken) noexcept
+	{
+		auto pWaiter = listWoken.Front();
+		while (pWaiter != nullptr)
+		{
+			auto pNext = pWaiter->m_pNext;
+			pWaiter->Release();
+			pWaiter = pNext;
+		}
+	}
+
+private:
+	static inline NoopExecutor s_InlineExecutor{};
+
+	BoundedQueue<T> m_Queue;
+	std::atomic<bool> m_bClosed{ false };
+
+	// 两个链表上等待者的总数，收发之后不加锁地检查它
+	std::atomic<std::size_t> m_nWaiters{ 0 };
+	std::mutex m_lMutex;
+	WaitList m_listSenders;
+	WaitList m_listReceivers;
+};
@@ -0,0 +1,998 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Executor.h"
+
+/// 事件循环调度器
+/// 前面的调度器只能执行计算，协程想等一个文件描述符就只能阻塞线程
+/// EventLoopExecutor 用一个线程跑事件循环，既是普通的调度器，又负责 I/O：
+///		1. 协程 co_await AsyncRead(loop, fd, buffer) 时挂起，I/O 请求交给事件循环
+///		2. 事件循环每一轮把这段时间攒下的请求一次性提交给内核
+///		3. I/O 完成后，协程回到它自己的调度器上恢复（如果就运行在事件循环上，直接在这里恢复）
+///
+/// 后端优先使用 io_uring（直接通过系统调用，不依赖 liburing），io_uring 不可用时退回 epoll
+///		io_uring：	真正的异步 I/O，一次 io_uring_enter 提交整批请求并收割完成事件
+///					注册过的缓冲区可以用 READ_FIXED/WRITE_FIXED，内核不用每次都重新映射用户内存
+///		epoll：		先直接尝试一次非阻塞的系统调用，返回 EAGAIN 时再等待就绪
+///					这时文件描述符需要设置为 O_NONBLOCK
+/// 事件循环析构时还没有完成的 I/O 会被丢弃，等待它们的协程不会再恢复
+/// 可以取消还没有完成的 I/O：io_uring 提交 ASYNC_CANCEL，epoll 直接从等待中移除，协程以 -ECANCELED 恢复
+
+/// ---------- I/O Operation ----------
+/// 一次 I/O 请求，放在 Awaiter 里，跟着等待方的协程帧一起分配
+struct IoOperation
+{
+	enum class Type
+	{
+		Read,
+		Write,
+		ReadFixed,
+		WriteFixed,
+		Accept,
+		Connect,
+	};
+
+	Type m_eType = Type::Read;
+	int m_nFd = -1;
+
+	// Read/Write 的缓冲区，偏移为 -1 时使用文件当前的位置
+	void* m_pBuffer = nullptr;
+	std::size_t m_nLength = 0;
+	std::int64_t m_nOffset = -1;
+	// ReadFixed/WriteFixed 使用的注册缓冲区下标
+	int m_nBufferIndex = 0;
+
+	// Accept 输出对端地址，Connect 输入目标地址
+	sockaddr* m_pAddress = nullptr;
+	socklen_t m_nAddressLength = 0;
+
+	// 和系统调用的约定一致：>= 0 表示成功，< 0 表示 -errno
+	int m_nResult = 0;
+	// epoll 后端：connect 已经发起，等待可写后再检查结果
+	bool m_bInProgress = false;
+
+	// 完成后恢复的协程以及它的调度器
+	std::coroutine_handle<> m_hCoroutine{};
+	AbstractExecutor* m_pExecutor = nullptr;
+
+	// 可以被取消的请求：提交时 token 已经请求停止就直接以 -ECANCELED 完成
+	// 取消请求可能在 I/O 完成之后才到达，地址也可能已经被新的请求复用，所以用编号确认是不是同一次请求
+	std::stop_token m_tokStop{};
+	std::uint64_t m_nCancelId = 0;
+	// 只在事件循环线程上访问，已经收到取消请求，不要再重新提交
+	bool m_bCancelRequested = false;
+};
+
+/// ---------- Backend ----------
+/// 只在事件循环线程上调用，不需要考虑线程安全
+class IoBackend
+{
+public:
+	virtual ~IoBackend() = default;
+
+	virtual const char* Name() const = 0;
+
+	// 加入本轮的批次，Wait 的时候一起提交
+	virtual void Prepare(IoOperation* pOperation) = 0;
+
+	// 提交本轮的批次，bBlock 为 true 时至少等到一个事件（I/O 完成或者被唤醒）
+	virtual void Wait(bool bBlock, std::vector<IoOperation*>& vecCompleted) = 0;
+
+	virtual void RegisterBuffers(std::span<const iovec> buffers) = 0;
+
+	// 取消一个已经 Prepare 过、还没有完成的请求，它之后会以 -ECANCELED（或者正常的结果）出现在 Wait 中
+	virtual void Cancel(IoOperation* pOperation) = 0;
+};
+
+/// io_uring 后端
+/// 提交队列（SQ）和完成队列（CQ）都是和内核共享的环形缓冲区
+/// 填写 SQE 只是写内存，真正的系统调用只在 Wait 中发生一次
+/// 唤醒用的 eventfd 上始终挂着一个读请求，user_data 为 0
+/// 较旧的内核对 O_NONBLOCK 的文件描述符会直接返回 -EAGAIN，这时先 POLL_ADD 等待就绪再重新提交
+/// 用 user_data 的最低位区分 POLL_ADD 和普通请求，ASYNC_CANCEL 自己的完成事件 user_data 为 kCancelTag
+/// 提交队列满了又提交不出去（完成队列也满了）时不等待，请求先放进 m_dequePending，收割之后再填写
+class UringBackend : public IoBackend
+{
+public:
+	UringBackend(unsigned nEntries, int nWakeFd)
+		: m_nWakeFd(nWakeFd)
+	{
+		io_uring_params params{};
+		m_nRingFd = static_cast<int>(::syscall(__NR_io_uring_setup, nEntries, &params));
+		if (m_nRingFd < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "io_uring_setup");
+		}
+
+		m_nSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_nCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool bSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (bSingleMap)
+		{
+			m_nSqRingSize = m_nCqRingSize = std::max(m_nSqRingSize, m_nCqRingSize);
+		}
+		try
+		{
+			m_pSqRing = Map(m_nSqRingSize, IORING_OFF_SQ_RING);
+			m_pCqRing = bSingleMap ? m_pSqRing : Map(m_nCqRingSize, IORING_OFF_CQ_RING);
+			m_nSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			m_pSqes = static_cast<io_uring_sqe*>(Map(m_nSqesSize, IORING_OFF_SQES));
+		}
+		catch (...)
+		{
+			// 构造函数抛出时析构函数不会执行，已经映射的区域要在这里释放
+			Release();
+			throw;
+		}
+
+		auto pSq = static_cast<std::byte*>(m_pSqRing);
+		m_pSqHead = reinterpret_cast<unsigned*>(pSq + params.sq_off.head);
+		m_pSqTail = reinterpret_cast<unsigned*>(pSq + params.sq_off.tail);
+		m_pSqArray = reinterpret_cast<unsigned*>(pSq + params.sq_off.array);
+		m_nSqMask = *reinterpret_cast<unsigned*>(pSq + params.sq_off.ring_mask);
+		m_nSqEntries = params.sq_entries;
+		m_nSqLocalTail = *m_pSqTail;
+
+		auto pCq = static_cast<std::byte*>(m_pCqRing);
+		m_pCqHead = reinterpret_cast<unsigned*>(pCq + params.cq_off.head);
+		m_pCqTail = reinterpret_cast<unsigned*>(pCq + params.cq_off.tail);
+		m_pCqes = reinterpret_cast<io_uring_cqe*>(pCq + params.cq_off.cqes);
+		m_nCqMask = *reinterpret_cast<unsigned*>(pCq + params.cq_off.ring_mask);
+
+		Push({ SqeKind::Wake, 0 });
+	}
+
+	~UringBackend() override
+	{
+		Release();
+	}
+
+	const char* Name() const override { return "io_uring"; }
+
+	void Prepare(IoOperation* pOperation) override
+	{
+		Push({ SqeKind::Operation, reinterpret_cast<std::uint64_t>(pOperation) });
+	}
+
+	void Wait(bool bBlock, std::vector<IoOperation*>& vecCompleted) override
+	{
+		// 还有请求没能放进提交队列时不能阻塞，它们可能就是调用方在等的
+		Flush();
+		Enter(bBlock && m_dequePending.empty() ? 1 : 0);
+		Reap(vecCompleted);
+		Flush();
+	}
+
+	void RegisterBuffers(std::span<const iovec> buffers) override
+	{
+		if (::syscall(__NR_io_uring_register, m_nRingFd, IORING_REGISTER_BUFFERS,
+			buffers.data(), static_cast<unsigned>(buffers.size())) < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "io_uring_register");
+		}
+	}
+
+	// 请求可能正在等待就绪（POLL_ADD），也可能已经提交给内核，两个都取消
+	void Cancel(IoOperation* pOperation) override
+	{
+		Push({ SqeKind::Cancel, reinterpret_cast<std::uint64_t>(pOperation) });
+		Push({ SqeKind::Cancel, reinterpret_cast<std::uint64_t>(pOperation) | kPollTag });
+	}
+
+private:
+	enum class SqeKind
+	{
+		Operation,
+		Poll,
+		Cancel,
+		Wake,
+	};
+
+	// 还没有填写到提交队列中的请求
+	// Operation 和 Poll 的 m_nUserData 是请求的地址，Cancel 的是要取消的 user_data
+	struct PendingSqe
+	{
+		SqeKind m_eKind;
+		std::uint64_t m_nUserData;
+	};
+
+	void* Map(std::size_t nSize, std::uint64_t nOffset)
+	{
+		auto p = ::mmap(nullptr, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRingFd, static_cast<off_t>(nOffset));
+		if (p == MAP_FAILED)
+		{
+			throw std::system_error(errno, std::system_category(), "mmap io_uring");
+		}
+		return p;
+	}
+
+	void Release()
+	{
+		if (m_pSqes)
+		{
+			::munmap(m_pSqes, m_nSqesSize);
+		}
+		if (m_pCqRing && m_pCqRing != m_pSqRing)
+		{
+			::munmap(m_pCqRing, m_nCqRingSize);
+		}
+		if (m_pSqRing)
+		{
+			::munmap(m_pSqRing, m_nSqRingSize);
+		}
+		::close(m_nRingFd);
+	}
+
+	// 前面还有暂存的请求时也要排在后面，保证 ASYNC_CANCEL 不会跑到它要取消的请求前面
+	void Push(const PendingSqe& request)
+	{
+		if (m_dequePending.empty() && Fill(request))
+		{
+			return;
+		}
+		m_dequePending.push_back(request);
+	}
+
+	void Flush()
+	{
+		while (!m_dequePending.empty() && Fill(m_dequePending.front()))
+		{
+			m_dequePending.pop_front();
+		}
+	}
+
+	// 返回 false 表示提交队列满了
+	bool Fill(const PendingSqe& request)
+	{
+		auto pSqe = NextSqe();
+		if (pSqe == nullptr)
+		{
+			return false;
+		}
+		switch (request.m_eKind)
+		{
+		case SqeKind::Operation:
+			FillOperation(pSqe, reinterpret_cast<IoOperation*>(request.m_nUserData));
+			break;
+		case SqeKind::Poll:
+			FillPoll(pSqe, reinterpret_cast<IoOperation*>(request.m_nUserData));
+			break;
+		case SqeKind::Cancel:
+			pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+			pSqe->fd = -1;
+			pSqe->addr = request.m_nUserData;
+			pSqe->user_data = kCancelTag;
+			break;
+		case SqeKind::Wake:
+			pSqe->opcode = IORING_OP_READ;
+			pSqe->fd = m_nWakeFd;
+			pSqe->addr = reinterpret_cast<std::uint64_t>(&m_nWakeValue);
+			pSqe->len = sizeof(m_nWakeValue);
+			pSqe->user_data = 0;
+			break;
+		}
+		return true;
+	}
+
+	static void FillOperation(io_uring_sqe* pSqe, IoOperation* pOperation)
+	{
+		switch (pOperation->m_eType)
+		{
+		case IoOperation::Type::Read:
+		case IoOperation::Type::Write:
+			pSqe->opcode = pOperation->m_eType == IoOperation::Type::Read ? IORING_OP_READ : IORING_OP_WRITE;
+			pSqe->addr = reinterpret_cast<std::uint64_t>(pOperation->m_pBuffer);
+			pSqe->len = static_cast<std::uint32_t>(pOperation->m_nLength);
+			pSqe->off = static_cast<std::uint64_t>(pOperation->m_nOffset);
+			break;
+		case IoOperation::Type::ReadFixed:
+		case IoOperation::Type::WriteFixed:
+			pSqe->opcode = pOperation->m_eType == IoOperation::Type::ReadFixed ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+			pSqe->addr = reinterpret_cast<std::uint64_t>(pOperation->m_pBuffer);
+			pSqe->len = static_cast<std::uint32_t>(pOperation->m_nLength);
+			pSqe->off = static_cast<std::uint64_t>(pOperation->m_nOffset);
+			pSqe->buf_index = static_cast<std::uint16_t>(pOperation->m_nBufferIndex);
+			break;
+		case IoOperation::Type::Accept:
+			pSqe->opcode = IORING_OP_ACCEPT;
+			pSqe->addr = reinterpret_cast<std::uint64_t>(pOperation->m_pAddress);
+			pSqe->addr2 = reinterpret_cast<std::uint64_t>(&pOperation->m_nAddressLength);
+			pSqe->accept_flags = SOCK_CLOEXEC;
+			break;
+		case IoOperation::Type::Connect:
+			pSqe->opcode = IORING_OP_CONNECT;
+			pSqe->addr = reinterpret_cast<std::uint64_t>(pOperation->m_pAddress);
+			pSqe->off = pOperation->m_nAddressLength;
+			break;
+		}
+		pSqe->fd = pOperation->m_nFd;
+		pSqe->user_data = reinterpret_cast<std::uint64_t>(pOperation);
+	}
+
+	static void FillPoll(io_uring_sqe* pSqe, IoOperation* pOperation)
+	{
+		bool bRead = pOperation->m_eType == IoOperation::Type::Read
+			|| pOperation->m_eType == IoOperation::Type::ReadFixed
+			|| pOperation->m_eType == IoOperation::Type::Accept;
+		pSqe->opcode = IORING_OP_POLL_ADD;
+		pSqe->fd = pOperation->m_nFd;
+		pSqe->poll32_events = bRead ? POLLIN : POLLOUT;
+		pSqe->user_data = reinterpret_cast<std::uint64_t>(pOperation) | kPollTag;
+	}
+
+	// 提交队列满了先把已经填好的交给内核，内核也取不走（完成队列满了）时返回 nullptr
+	io_uring_sqe* NextSqe()
+	{
+		if (SqFull())
+		{
+			Enter(0);
+			if (SqFull())
+			{
+				return nullptr;
+			}
+		}
+		auto nIndex = m_nSqLocalTail & m_nSqMask;
+		auto pSqe = &m_pSqes[nIndex];
+		std::memset(pSqe, 0, sizeof(io_uring_sqe));
+		m_pSqArray[nIndex] = nIndex;
+		++m_nSqLocalTail;
+		return pSqe;
+	}
+
+	bool SqFull() const
+	{
+		return m_nSqLocalTail - std::atomic_ref(*m_pSqHead).load(std::memory_order_acquire) == m_nSqEntries;
+	}
+
+	void Enter(unsigned nMinComplete)
+	{
+		// 发布本轮填写的所有 SQE，一次系统调用提交
+		std::atomic_ref(*m_pSqTail).store(m_nSqLocalTail, std::memory_order_release);
+		auto nToSubmit = m_nSqLocalTail - m_nSqSubmitted;
+		unsigned nFlags = nMinComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+		while (true)
+		{
+			auto nResult = ::syscall(__NR_io_uring_enter, m_nRingFd, nToSubmit, nMinComplete, nFlags, nullptr, 0);
+			if (nResult >= 0)
+			{
+				m_nSqSubmitted += static_cast<unsigned>(nResult);
+				return;
+			}
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN || errno == EBUSY)
+			{
+				// 完成队列满了，由调用方收割后下一轮再提交
+				return;
+			}
+			throw std::system_error(errno, std::system_category(), "io_uring_enter");
+		}
+	}
+
+	// 需要重新提交的请求先放进 m_dequePending，等 CQ 的 head 发布之后由 Flush 填写
+	// 否则填写时提交队列满了，Enter 会因为完成队列还是满的而一直提交不出去
+	void Reap(std::vector<IoOperation*>& vecCompleted)
+	{
+		auto nHead = *m_pCqHead;
+		auto nTail = std::atomic_ref(*m_pCqTail).load(std::memory_order_acquire);
+		for (; nHead != nTail; ++nHead)
+		{
+			auto& cqe = m_pCqes[nHead & m_nCqMask];
+			if (cqe.user_data == 0)
+			{
+				m_dequePending.push_back({ SqeKind::Wake, 0 });
+				continue;
+			}
+			if (cqe.user_data == kCancelTag)
+			{
+				continue;
+			}
+			auto pOperation = reinterpret_cast<IoOperation*>(cqe.user_data & ~kPollTag);
+			auto nResult = cqe.res;
+			if (pOperation->m_bCancelRequested)
+			{
+				// 取消请求到达时它正好在 POLL_ADD 和重新提交之间，不再重新提交
+				nResult = nResult < 0 || (cqe.user_data & kPollTag) ? -ECANCELED : nResult;
+			}
+			else if (cqe.user_data & kPollTag)
+			{
+				m_dequePending.push_back({ SqeKind::Operation, reinterpret_cast<std::uint64_t>(pOperation) });
+				continue;
+			}
+			else if (nResult == -EAGAIN)
+			{
+				m_dequePending.push_back({ SqeKind::Poll, reinterpret_cast<std::uint64_t>(pOperation) });
+				continue;
+			}
+			pOperation->m_nResult = nResult;
+			vecCompleted.push_back(pOperation);
+		}
+		std::atomic_ref(*m_pCqHead).store(nHead, std::memory_order_release);
+	}
+
+private:
+	static constexpr std::uint64_t kPollTag = 1;
+	// IoOperation 至少按 8 字节对齐，不会和它的地址冲突
+	static constexpr std::uint64_t kCancelTag = 2;
+
+	int m_nRingFd = -1;
+	int m_nWakeFd;
+	std::uint64_t m_nWakeValue = 0;
+
+	void* m_pSqRing = nullptr;
+	void* m_pCqRing = nullptr;
+	io_uring_sqe* m_pSqes = nullptr;
+	std::size_t m_nSqRingSize = 0;
+	std::size_t m_nCqRingSize = 0;
+	std::size_t m_nSqesSize = 0;
+
+	unsigned* m_pSqHead = nullptr;
+	unsigned* m_pSqTail = nullptr;
+	unsigned* m_pSqArray = nullptr;
+	unsigned m_nSqMask = 0;
+	unsigned m_nSqEntries = 0;
+	// 已经填写的 SQE 和已经被内核取走的 SQE
+	unsigned m_nSqLocalTail = 0;
+	unsigned m_nSqSubmitted = 0;
+
+	unsigned* m_pCqHead = nullptr;
+	unsigned* m_pCqTail = nullptr;
+	io_uring_cqe* m_pCqes = nullptr;
+	unsigned m_nCqMask = 0;
+
+	std::deque<PendingSqe> m_dequePending;
+};
+
+/// epoll 后端
+/// 就绪通知而不是完成通知：先尝试一次系统调用，EAGAIN 时才登记到 epoll 上等待
+/// 每个文件描述符最多同时有一个读方向（Read/Accept）和一个写方向（Write/Connect）的请求
+class EpollBackend : public IoBackend
+{
+public:
+	explicit EpollBackend(int nWakeFd)
+		: m_nWakeFd(nWakeFd)
+	{
+		m_nEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+		if (m_nEpollFd < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "epoll_create1");
+		}
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = m_nWakeFd;
+		::epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, m_nWakeFd, &event);
+	}
+
+	~EpollBackend() override
+	{
+		::close(m_nEpollFd);
+	}
+
+	const char* Name() const override { return "epoll"; }
+
+	void Prepare(IoOperation* pOperation) override
+	{
+		if (Perform(pOperation))
+		{
+			m_vecReady.push_back(pOperation);
+			return;
+		}
+		auto& state = m_mapFds[pOperation->m_nFd];
+		(IsReadDirection(pOperation) ? state.m_pRead : state.m_pWrite) = pOperation;
+		Arm(pOperation->m_nFd, state);
+	}
+
+	void Wait(bool bBlock, std::vector<IoOperation*>& vecCompleted) override
+	{
+		vecCompleted.insert(vecCompleted.end(), m_vecReady.begin(), m_vecReady.end());
+		auto nTimeout = bBlock && m_vecReady.empty() ? -1 : 0;
+		m_vecReady.clear();
+
+		epoll_event events[64];
+		auto nCount = ::epoll_wait(m_nEpollFd, events, 64, nTimeout);
+		for (int i = 0; i < nCount; ++i)
+		{
+			auto nFd = events[i].data.fd;
+			if (nFd == m_nWakeFd)
+			{
+				std::uint64_t nValue = 0;
+				[[maybe_unused]] auto nRead = ::read(m_nWakeFd, &nValue, sizeof(nValue));
+				continue;
+			}
+			auto it = m_mapFds.find(nFd);
+			if (it == m_mapFds.end())
+			{
+				continue;
+			}
+			auto& state = it->second;
+			auto nEvents = events[i].events;
+			// 出错或者挂断时两个方向都重试一次，让系统调用返回具体的错误
+			if (state.m_pRead && (nEvents & (EPOLLIN | EPOLLERR | EPOLLHUP)) && Perform(state.m_pRead))
+			{
+				vecCompleted.push_back(std::exchange(state.m_pRead, nullptr));
+			}
+			if (state.m_pWrite && (nEvents & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && Perform(state.m_pWrite))
+			{
+				vecCompleted.push_back(std::exchange(state.m_pWrite, nullptr));
+			}
+			if (state.m_pRead || state.m_pWrite)
+			{
+				Arm(nFd, state);
+			}
+			else
+			{
+				m_mapFds.erase(it);
+			}
+		}
+	}
+
+	// epoll 没有注册缓冲区的概念，Fixed 请求按普通的读写执行
+	void RegisterBuffers(std::span<const iovec>) override {}
+
+	// 还在等待就绪时直接移除，下一次 Wait 时返回
+	void Cancel(IoOperation* pOperation) override
+	{
+		auto it = m_mapFds.find(pOperation->m_nFd);
+		if (it == m_mapFds.end())
+		{
+			return;
+		}
+		auto& state = it->second;
+		auto& pWaiting = IsReadDirection(pOperation) ? state.m_pRead : state.m_pWrite;
+		if (pWaiting != pOperation)
+		{
+			return;
+		}
+		pWaiting = nullptr;
+		pOperation->m_nResult = -ECANCELED;
+		m_vecReady.push_back(pOperation);
+		if (state.m_pRead || state.m_pWrite)
+		{
+			Arm(it->first, state);
+		}
+		else
+		{
+			// 还挂着的 EPOLLONESHOT 触发时找不到 FdState，直接忽略
+			m_mapFds.erase(it);
+		}
+	}
+
+private:
+	struct FdState
+	{
+		IoOperation* m_pRead = nullptr;
+		IoOperation* m_pWrite = nullptr;
+		bool m_bAdded = false;
+	};
+
+	static bool IsReadDirection(const IoOperation* pOperation)
+	{
+		return pOperation->m_eType == IoOperation::Type::Read
+			|| pOperation->m_eType == IoOperation::Type::ReadFixed
+			|| pOperation->m_eType == IoOperation::Type::Accept;
+	}
+
+	// 执行一次系统调用，返回 false 表示需要等待就绪
+	static bool Perform(IoOperation* pOperation)
+	{
+		long nResult = 0;
+		switch (pOperation->m_eType)
+		{
+		case IoOperation::Type::Read:
+		case IoOperation::Type::ReadFixed:
+			nResult = pOperation->m_nOffset < 0
+				? ::read(pOperation->m_nFd, pOperation->m_pBuffer, pOperation->m_nLength)
+				: ::pread(pOperation->m_nFd, pOperation->m_pBuffer, pOperation->m_nLength, pOperation->m_nOffset);
+			break;
+		case IoOperation::Type::Write:
+		case IoOperation::Type::WriteFixed:
+			nResult = pOperation->m_nOffset < 0
+				? ::write(pOperation->m_nFd, pOperation->m_pBuffer, pOperation->m_nLength)
+				: ::pwrite(pOperation->m_nFd, pOperation->m_pBuffer, pOperation->m_nLength, pOperation->m_nOffset);
+			break;
+		case IoOperation::Type::Accept:
+			nResult = ::accept4(pOperation->m_nFd, pOperation->m_pAddress,
+				pOperation->m_pAddress ? &pOperation->m_nAddressLength : nullptr, SOCK_CLOEXEC);
+			break;
+		case IoOperation::Type::Connect:
+			if (pOperation->m_bInProgress)
+			{
+				// 可写之后通过 SO_ERROR 取得 connect 的结果
+				int nError = 0;
+				socklen_t nLength = sizeof(nError);
+				::getsockopt(pOperation->m_nFd, SOL_SOCKET, SO_ERROR, &nError, &nLength);
+				pOperation->m_nResult = -nError;
+				return true;
+			}
+			nResult = ::connect(pOperation->m_nFd, pOperation->m_pAddress, pOperation->m_nAddressLength);
+			if (nResult < 0 && errno == EINPROGRESS)
+			{
+				pOperation->m_bInProgress = true;
+				return false;
+			}
+			break;
+		}
+		if (nResult < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return false;
+			}
+			pOperation->m_nResult = -errno;
+			return true;
+		}
+		pOperation->m_nResult = static_cast<int>(nResult);
+		return true;
+	}
+
+	// 用 EPOLLONESHOT 登记仍在等待的方向，每次触发后重新登记
+	void Arm(int nFd, FdState& state)
+	{
+		epoll_event event{};
+		event.events = EPOLLONESHOT | (state.m_pRead ? EPOLLIN : 0u) | (state.m_pWrite ? EPOLLOUT : 0u);
+		event.data.fd = nFd;
+		// 文件描述符关闭后会自动从 epoll 中移除，编号也可能被复用，所以 ADD/MOD 失败时换另一个再试
+		int nOp = state.m_bAdded ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (::epoll_ctl(m_nEpollFd, nOp, nFd, &event) < 0)
+		{
+			nOp = errno == ENOENT ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+			if (::epoll_ctl(m_nEpollFd, nOp, nFd, &event) < 0)
+			{
+				// 不支持 epoll 的文件描述符（例如普通文件），直接以错误结束
+				auto nError = -errno;
+				for (auto pOperation : { std::exchange(state.m_pRead, nullptr), std::exchange(state.m_pWrite, nullptr) })
+				{
+					if (pOperation != nullptr)
+					{
+						pOperation->m_nResult = nError;
+						m_vecReady.push_back(pOperation);
+					}
+				}
+				m_mapFds.erase(nFd);
+				return;
+			}
+		}
+		state.m_bAdded = true;
+	}
+
+private:
+	int m_nEpollFd = -1;
+	int m_nWakeFd;
+	std::unordered_map<int, FdState> m_mapFds;
+	// 提交时就已经完成的请求，下一次 Wait 时返回
+	std::vector<IoOperation*> m_vecReady;
+};
+
+/// ---------- Event Loop Executor ----------
+class EventLoopExecutor : public AbstractExecutor
+{
+public:
+	enum class Backend
+	{
+		Auto,
+		Uring,
+		Epoll,
+	};
+
+	explicit EventLoopExecutor(Backend eBackend = Backend::Auto, unsigned nEntries = 256)
+	{
+		// 阻塞的 eventfd，io_uring 上挂着的读请求会一直等到被唤醒
+		m_nWakeFd = ::eventfd(0, EFD_CLOEXEC);
+		if (m_nWakeFd < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "eventfd");
+		}
+		try
+		{
+			if (eBackend != Backend::Epoll)
+			{
+				try
+				{
+					m_pBackend = std::make_unique<UringBackend>(nEntries, m_nWakeFd);
+				}
+				catch (std::system_error&)
+				{
+					// 内核太旧或者被 seccomp 禁用了 io_uring
+					if (eBackend == Backend::Uring)
+					{
+						throw;
+					}
+				}
+			}
+			if (!m_pBackend)
+			{
+				m_pBackend = std::make_unique<EpollBackend>(m_nWakeFd);
+			}
+			m_Thread = std::thread([this]() {
+				Run();
+				});
+		}
+		catch (...)
+		{
+			// 析构函数不会执行，后端要在 eventfd 之前释放
+			m_pBackend.reset();
+			::close(m_nWakeFd);
+			throw;
+		}
+	}
+
+	~EventLoopExecutor()
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_bStopped = true;
+		}
+		Wake();
+		m_Thread.join();
+		m_pBackend.reset();
+		::close(m_nWakeFd);
+	}
+
+	EventLoopExecutor(EventLoopExecutor&) = delete;
+	EventLoopExecutor& operator=(EventLoopExecutor&) = delete;
+
+	void Execute(std::function<void()>&& func) override
+	{
+		Post([&](Incoming& incoming) {
+			incoming.m_vecFuncs.push_back(std::move(func));
+			});
+	}
+
+	void Schedule(std::coroutine_handle<> handle) override
+	{
+		Post([&](Incoming& incoming) {
+			incoming.m_vecHandles.push_back(handle);
+			});
+	}
+
+	// 由 I/O Awaiter 调用，在事件循环线程上直接加入本轮的批次
+	void Submit(IoOperation* pOperation)
+	{
+		if (s_pCurrentLoop == this)
+		{
+			Prepare(pOperation);
+			return;
+		}
+		Post([&](Incoming& incoming) {
+			incoming.m_vecOperations.push_back(pOperation);
+			});
+	}
+
+	// 取消编号从 1 开始，0 表示请求不能被取消
+	std::uint64_t NextCancelId()
+	{
+		return m_nNextCancelId.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// 可以在任意线程上调用，nCancelId 和请求当前的编号不一致时什么也不做
+	void Cancel(IoOperation* pOperation, std::uint64_t nCancelId)
+	{
+		if (s_pCurrentLoop == this)
+		{
+			CancelInLoop(pOperation, nCancelId);
+			return;
+		}
+		Execute([this, pOperation, nCancelId]() {
+			CancelInLoop(pOperation, nCancelId);
+			});
+	}
+
+	/// 注册固定缓冲区，之后可以用 AsyncReadFixed/AsyncWriteFixed 按下标使用
+	/// 在事件循环线程上执行，调用方等待注册完成
+	void RegisterBuffers(std::span<const iovec> buffers)
+	{
+		std::promise<void> promise;
+		auto future = promise.get_future();
+		Execute([this, buffers, &promise]() {
+			try
+			{
+				m_pBackend->RegisterBuffers(buffers);
+				promise.set_value();
+			}
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
+			}
+			});
+		future.get();
+	}
+
+	const char* BackendName() const
+	{
+		return m_pBackend->Name();
+	}
+
+	bool IsInLoopThread() const
+	{
+		return s_pCurrentLoop == this;
+	}
+
+	bool IsInWorkerThread() const override
+	{
+		return IsInLoopThread();
+	}
+
+private:
+	struct Incoming
+	{
+		std::vector<std::function<void()>> m_vecFuncs;
+		std::vector<std::coroutine_handle<>> m_vecHandles;
+		std::vector<IoOperation*> m_vecOperations;
+
+		bool Empty() const
+		{
+			return m_vecFuncs.empty() && m_vecHandles.empty() && m_vecOperations.empty();
+		}
+	};
+
+	template <typename F>
+	void Post(F&& push)
+	{
+		std::lock_guard lock(m_lMutex);
+		push(m_Incoming);
+		// 已经有人唤醒过了，或者就在事件循环线程上，都不需要再写 eventfd
+		// 放进去的任务解锁之前就可能被执行，执行完之后调用方可以马上析构 EventLoopExecutor
+		// 所以在锁内写 eventfd，析构函数拿到锁时这里已经不会再访问 m_nWakeFd 了
+		if (!m_bWakePending && s_pCurrentLoop != this)
+		{
+			Wake();
+		}
+		m_bWakePending = true;
+	}
+
+	void Prepare(IoOperation* pOperation)
+	{
+		if (pOperation->m_nCancelId != 0)
+		{
+			// 取消请求可能比请求本身先到，那时候还找不到它，在这里补上
+			if (pOperation->m_tokStop.stop_requested())
+			{
+				pOperation->m_nResult = -ECANCELED;
+				m_vecCancelled.push_back(pOperation);
+				return;
+			}
+			m_mapCancellable[pOperation] = pOperation->m_nCancelId;
+		}
+		m_pBackend->Prepare(pOperation);
+	}
+
+	void CancelInLoop(IoOperation* pOperation, std::uint64_t nCancelId)
+	{
+		auto it = m_mapCancellable.find(pOperation);
+		if (it == m_mapCancellable.end() || it->second != nCancelId || pOperation->m_bCancelRequested)
+		{
+			return;
+		}
+		pOperation->m_bCancelRequested = true;
+		m_pBackend->Cancel(pOperation);
+	}
+
+	void Wake()
+	{
+		std::uint64_t nValue = 1;
+		[[maybe_unused]] auto nWritten = ::write(m_nWakeFd, &nValue, sizeof(nValue));
+	}
+
+	void Run()
+	{
+		s_pCurrentLoop = this;
+		Incoming incoming;
+		std::vector<IoOperation*> vecCompleted;
+		while (true)
+		{
+			bool bStopped = false;
+			{
+				std::lock_guard lock(m_lMutex);
+				std::swap(incoming, m_Incoming);
+				m_bWakePending = false;
+				bStopped = m_bStopped;
+			}
+			// 事件循环每一轮取走的任务数就是它的队列深度
+			CoroutineMetrics::RecordQueueDepth(incoming.m_vecFuncs.size() + incoming.m_vecHandles.size() + incoming.m_vecOperations.size());
+			for (auto pOperation : incoming.m_vecOperations)
+			{
+				Prepare(pOperation);
+			}
+			for (auto& func : incoming.m_vecFuncs)
+			{
+				func();
+			}
+			for (auto handle : incoming.m_vecHandles)
+			{
+				handle.resume();
+			}
+			incoming.m_vecFuncs.clear();
+			incoming.m_vecHandles.clear();
+			incoming.m_vecOperations.clear();
+			if (bStopped)
+			{
+				break;
+			}
+
+			// 执行期间又有新的任务进来，就不能阻塞等待
+			bool bBlock = false;
+			{
+				std::lock_guard lock(m_lMutex);
+				bBlock = m_Incoming.Empty() && !m_bStopped && m_vecCancelled.empty();
+			}
+			// 本轮所有的 I/O 请求在这里一次性提交
+			m_pBackend->Wait(bBlock, vecCompleted);
+			vecCompleted.insert(vecCompleted.end(), m_vecCancelled.begin(), m_vecCancelled.end());
+			m_vecCancelled.clear();
+			for (auto pOperation : vecCompleted)
+			{
+				if (pOperation->m_nCancelId != 0)
+				{
+					m_mapCancellable.erase(pOperation);
+				}
+				// 恢复后 Awaiter 可能马上被销毁，先取出需要的内容
+				auto hCoroutine = pOperation->m_hCoroutine;
+				auto pExecutor = pOperation->m_pExecutor;
+				if (pExecutor == nullptr || pExecutor == this)
+				{
+					hCoroutine.resume();
+				}
+				else
+				{
+					pExecutor->Schedule(hCoroutine);
+				}
+			}
+			vecCompleted.clear();
+		}
+		s_pCurrentLoop = nullptr;
+	}
+
+private:
+	static inline thread_local EventLoopExecutor* s_pCurrentLoop = nullptr;
+
+	int m_nWakeFd = -1;
+	std::unique_ptr<IoBackend> m_pBackend;
+
+	// 只在事件循环线程上访问：还没有完成的可取消请求，提交前就已经被取消的请求
+	std::unordered_map<IoOperation*, std::uint64_t> m_mapCancellable;
+	std::vector<IoOperation*> m_vecCancelled;
+	std::atomic<std::uint64_t> m_nNextCancelId{ 1 };
+
+	std::mutex m_lMutex;
+	Incoming m_Incoming;
+	bool m_bWakePending = false;
+	bool m_bStopped = false;
+
+	std::thread m_Thread;
+};
+
+#endif
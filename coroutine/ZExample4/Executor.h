@@ -1,3 +1,15 @@
+#pragma once
+
+#include <coroutine>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+
+#include "Instrumentation.h"
+
 /// 调度器
 /// 为了实现协程的异步调度逻辑，我们需要提供调度器的实现
 /// 调度器实际上就是负责执行一段逻辑的代码
@@ -16,3 +28,168 @@
 /// 可以确保逻辑的一致性和正确性
 /// 所以这里我们放到 Promise Type 里面
 
+
+/// ---------- Executor ----------
+/// 调度器接口
+/// 具体的调度器只需要实现 Execute，决定一段逻辑在哪个线程上执行
+class AbstractExecutor
+{
+public:
+	virtual ~AbstractExecutor() = default;
+
+	// 执行一段逻辑
+	virtual void Execute(std::function<void()>&& func) = 0;
+
+	// 恢复一个已经挂起的协程，默认包装成一段逻辑交给 Execute
+	virtual void Schedule(std::coroutine_handle<> handle)
+	{
+		Execute([handle]() {
+			handle.resume();
+			});
+	}
+
+	// 当前线程是不是这个调度器自己的工作线程，用来检查会阻塞线程的等待，默认不知道，返回 false
+	virtual bool IsInWorkerThread() const
+	{
+		return false;
+	}
+};
+
+/// 直接在当前线程上执行，行为和没有调度器时完全一致
+class NoopExecutor : public AbstractExecutor
+{
+public:
+	void Execute(std::function<void()>&& func) override
+	{
+		func();
+	}
+
+	void Schedule(std::coroutine_handle<> handle) override
+	{
+		handle.resume();
+	}
+};
+
+/// 固定线程数的线程池
+/// 所有线程共享一个任务队列，互不依赖的协程会被分配到不同的线程上并行执行
+class ThreadPoolExecutor : public AbstractExecutor
+{
+public:
+	explicit ThreadPoolExecutor(std::size_t nThreadCount = std::thread::hardware_concurrency())
+	{
+		// hardware_concurrency 拿不到时会返回 0
+		if (nThreadCount == 0)
+		{
+			nThreadCount = 1;
+		}
+		m_vecWorkers.reserve(nThreadCount);
+		for (std::size_t i = 0; i < nThreadCount; ++i)
+		{
+			m_vecWorkers.emplace_back([this]() {
+				WorkerLoop();
+				});
+		}
+	}
+
+	~ThreadPoolExecutor()
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_bStopped = true;
+		}
+		m_conQueue.notify_all();
+		for (auto& worker : m_vecWorkers)
+		{
+			worker.join();
+		}
+	}
+
+	ThreadPoolExecutor(ThreadPoolExecutor&) = delete;
+	ThreadPoolExecutor& operator=(ThreadPoolExecutor&) = delete;
+
+	void Execute(std::function<void()>&& func) override
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_queueTasks.push(std::move(func));
+		}
+		m_conQueue.notify_one();
+	}
+
+	std::size_t ThreadCount() const
+	{
+		return m_vecWorkers.size();
+	}
+
+	bool IsInWorkerThread() const override
+	{
+		return s_pCurrentPool == this;
+	}
+
+	// 全局共享的线程池，Task 默认调度到这里
+	static ThreadPoolExecutor& Shared()
+	{
+		static ThreadPoolExecutor executor;
+		return executor;
+	}
+
+private:
+	void WorkerLoop()
+	{
+		s_pCurrentPool = this;
+		while (true)
+		{
+			std::function<void()> func;
+			{
+				std::unique_lock lock(m_lMutex);
+				m_conQueue.wait(lock, [this]() {
+					return m_bStopped || !m_queueTasks.empty();
+					});
+				// 停止后也要先把队列里剩下的任务执行完
+				if (m_queueTasks.empty())
+				{
+					return;
+				}
+				func = std::move(m_queueTasks.front());
+				m_queueTasks.pop();
+				CoroutineMetrics::RecordQueueDepth(m_queueTasks.size());
+			}
+			func();
+		}
+	}
+
+private:
+	static inline thread_local const ThreadPoolExecutor* s_pCurrentPool = nullptr;
+
+	std::vector<std::thread> m_vecWorkers;
+	std::queue<std::function<void()>> m_queueTasks;
+
+	std::mutex m_lMutex;
+	std::condition_variable m_conQueue;
+	bool m_bStopped = false;
+};
+
+/// ---------- Dispatch Awaiter ----------
+/// co_await 它之后，协程会挂起并交给调度器恢复
+/// 用在 initial_suspend 上，协程从一开始就运行在自己的调度器上
+class DispatchAwaiter
+{
+public:
+	explicit DispatchAwaiter(AbstractExecutor* pExecutor) noexcept
+		: m_pExecutor(pExecutor) {};
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) const
+	{
+		m_pExecutor->Schedule(handle);
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	AbstractExecutor* m_pExecutor;
+};
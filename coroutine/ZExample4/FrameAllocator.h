@@ -0,0 +1,198 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// 协程帧分配器
+/// 每次调用协程，编译器都会通过 operator new 在堆上分配协程帧
+/// 如果 promise_type 中定义了 operator new/delete，编译器就会改用 promise_type 的版本
+/// 而协程帧往往生命周期很短，大小也就那么几种，非常适合放进按大小分级的空闲链表里复用
+
+/// 另外，如果 promise_type 的 operator new 可以接收协程的参数
+/// 编译器会先尝试 operator new(size, 协程参数...)，不匹配时才退回 operator new(size)
+/// 借此我们可以支持 std::allocator_arg 约定，让调用方指定 std::pmr::memory_resource
+///		Task<int> Foo(std::allocator_arg_t, std::pmr::memory_resource* pResource, ...)
+/// 这样一次请求中所有的协程帧都可以放进同一块 arena，最后一次性释放
+
+
+/// ---------- Frame Pool ----------
+/// 每个线程一份按大小分级的空闲链表
+/// 协程帧经常在一个线程上分配，在另一个线程上释放，释放时就放进释放线程的链表里
+class FramePool
+{
+	// 帧前面的头部，记录这块内存从哪里来，大小保持为默认对齐的整数倍
+	struct FrameHeader
+	{
+		std::pmr::memory_resource* m_pResource;
+		std::size_t m_nBlockSize;
+	};
+
+	struct FreeBlock
+	{
+		FreeBlock* m_pNext;
+	};
+
+	static constexpr std::size_t kHeaderSize = sizeof(FrameHeader);
+	static_assert(kHeaderSize % __STDCPP_DEFAULT_NEW_ALIGNMENT__ == 0);
+
+	// 64 字节一级，最大缓存 1KB 的块，更大的帧直接走全局 operator new
+	static constexpr std::size_t kSizeClassStep = 64;
+	static constexpr std::size_t kSizeClassCount = 16;
+	// 每一级每个线程最多缓存的块数，超出后还给全局 operator delete
+	static constexpr std::size_t kMaxCachedPerClass = 64;
+
+	struct ThreadCache
+	{
+		FreeBlock* m_arrFreeLists[kSizeClassCount]{};
+		std::size_t m_arrCounts[kSizeClassCount]{};
+
+		~ThreadCache()
+		{
+			s_bCacheAlive = false;
+			for (auto pBlock : m_arrFreeLists)
+			{
+				while (pBlock != nullptr)
+				{
+					::operator delete(std::exchange(pBlock, pBlock->m_pNext));
+				}
+			}
+		}
+	};
+
+public:
+	static void* Allocate(std::size_t nSize, std::pmr::memory_resource* pResource = nullptr)
+	{
+		auto nBlockSize = nSize + kHeaderSize;
+		void* pBlock = nullptr;
+		if (pResource != nullptr)
+		{
+			pBlock = pResource->allocate(nBlockSize, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+		}
+		else if (auto nClass = SizeClass(nBlockSize); nClass < kSizeClassCount)
+		{
+			nBlockSize = (nClass + 1) * kSizeClassStep;
+			auto pCache = LocalCache();
+			if (auto pFree = pCache != nullptr ? pCache->m_arrFreeLists[nClass] : nullptr)
+			{
+				pCache->m_arrFreeLists[nClass] = pFree->m_pNext;
+				--pCache->m_arrCounts[nClass];
+				pBlock = pFree;
+			}
+			else
+			{
+				pBlock = ::operator new(nBlockSize);
+			}
+		}
+		else
+		{
+			pBlock = ::operator new(nBlockSize);
+		}
+
+		auto pHeader = ::new (pBlock) FrameHeader{ pResource, nBlockSize };
+		return reinterpret_cast<std::byte*>(pHeader) + kHeaderSize;
+	}
+
+	static void Deallocate(void* pFrame) noexcept
+	{
+		auto pHeader = reinterpret_cast<FrameHeader*>(static_cast<std::byte*>(pFrame) - kHeaderSize);
+		auto pResource = pHeader->m_pResource;
+		auto nBlockSize = pHeader->m_nBlockSize;
+		if (pResource != nullptr)
+		{
+			// monotonic_buffer_resource 之类的 arena 这里什么都不做，等 arena 析构时统一释放
+			pResource->deallocate(pHeader, nBlockSize, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+			return;
+		}
+
+		auto nClass = SizeClass(nBlockSize);
+		if (nClass < kSizeClassCount)
+		{
+			auto pCache = LocalCache();
+			if (pCache != nullptr && pCache->m_arrCounts[nClass] < kMaxCachedPerClass)
+			{
+				auto pFree = ::new (static_cast<void*>(pHeader)) FreeBlock{ pCache->m_arrFreeLists[nClass] };
+				pCache->m_arrFreeLists[nClass] = pFree;
+				++pCache->m_arrCounts[nClass];
+				return;
+			}
+		}
+		::operator delete(pHeader);
+	}
+
+private:
+	static std::size_t SizeClass(std::size_t nBlockSize)
+	{
+		return (nBlockSize - 1) / kSizeClassStep;
+	}
+
+	// 线程退出时缓存可能先于其他 thread_local（或者静态对象）析构，它们持有的协程帧之后才释放
+	// 缓存已经析构时返回 nullptr，调用方和超出 kMaxCachedPerClass 时一样直接走全局 operator new/delete
+	static ThreadCache* LocalCache() noexcept
+	{
+		if (!s_bCacheAlive)
+		{
+			return nullptr;
+		}
+		thread_local ThreadCache cache;
+		return &cache;
+	}
+
+	// 平凡类型，不需要构造和析构，任何时候都可以访问；缓存还没有构造时也是 true，第一次使用时才构造
+	static inline thread_local constinit bool s_bCacheAlive = true;
+};
+
+
+/// ---------- Pooled Promise ----------
+/// promise_type 继承它就能让协程帧从 FramePool 里分配
+class PooledPromise
+{
+public:
+	static void* operator new(std::size_t nSize)
+	{
+		return FramePool::Allocate(nSize);
+	}
+
+	/// 协程参数中出现 std::allocator_arg 时，紧跟着的参数就是 memory_resource
+	/// 支持 std::pmr::memory_resource* 和 std::pmr::polymorphic_allocator
+	/// 成员函数协程的第一个参数是对象本身，所以这里不要求 allocator_arg 必须排在最前面
+	template <typename ...TArgs>
+		requires (std::is_same_v<std::remove_cvref_t<TArgs>, std::allocator_arg_t> || ...)
+	static void* operator new(std::size_t nSize, TArgs&... args)
+	{
+		return FramePool::Allocate(nSize, FindMemoryResource(args...));
+	}
+
+	static void operator delete(void* pFrame) noexcept
+	{
+		FramePool::Deallocate(pFrame);
+	}
+
+private:
+	template <typename ...TArgs>
+	static std::pmr::memory_resource* FindMemoryResource(TArgs&... args)
+	{
+		std::pmr::memory_resource* pResource = nullptr;
+		bool bAfterAllocatorArg = false;
+		([&](auto& arg) {
+			using TArg = std::remove_cvref_t<decltype(arg)>;
+			if (bAfterAllocatorArg && pResource == nullptr)
+			{
+				if constexpr (std::is_convertible_v<TArg, std::pmr::memory_resource*>)
+				{
+					pResource = arg;
+				}
+				else if constexpr (requires { { arg.resource() } -> std::convertible_to<std::pmr::memory_resource*>; })
+				{
+					pResource = arg.resource();
+				}
+			}
+			bAfterAllocatorArg = std::is_same_v<TArg, std::allocator_arg_t>;
+			}(args), ...);
+		return pResource;
+	}
+};
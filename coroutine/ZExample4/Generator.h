@@ -0,0 +1,593 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Cancellation.h"
+#include "Executor.h"
+#include "FrameAllocator.h"
+#include "SpscRing.h"
+
+/// Generator 来自 ZExample2，放到头文件中方便和 Task 一起复用
+
+/// 传值时不复制
+/// co_yield 的对象在协程挂起期间一直有效（局部变量或者 co_yield 表达式中的临时对象）
+/// 所以 promise_type 里只需要保存它的地址，等外部调用 next() 时再取值
+///		Generator<T>			next() 返回 T，co_yield 右值时移动，左值时复制一次
+///		Generator<const T&>		next() 直接返回引用，全程没有复制
+///								引用只在下一次调用 has_next()/next() 之前有效
+///
+/// 取消：token 请求停止后 has_next() 返回 false，range-for 也随之结束，不会再恢复协程
+/// token 可以作为协程参数传入，也可以用 set_stop_token 指定
+/// map/filter 等成员函数创建的 Generator 继承上游的 token，所以在源头指定一次，整条管道都会停下来
+
+template <typename T>
+struct Generator;
+
+/// 任意的 Generator<X>，map/flat_map 的上游和新的 Generator 不是同一个特化
+template <typename T>
+inline constexpr bool kIsGenerator = false;
+
+template <typename T>
+inline constexpr bool kIsGenerator<Generator<T>> = true;
+
+template <typename T>
+struct Generator
+{
+	class ExhaustedException : public std::exception {};
+
+	using value_type = std::remove_cvref_t<T>;
+
+	/// 协程帧从 FramePool 中分配，也支持 std::allocator_arg 指定 memory_resource
+	struct promise_type : public PooledPromise
+	{
+		/// 指向 co_yield 的对象，T 不再需要能默认构造
+		value_type* value = nullptr;
+		/// co_yield 的是不是右值，右值可以直接移动出去
+		bool is_rvalue = false;
+		bool is_ready = false;
+		/// 取消 token，为空时永远不会停止
+		std::stop_token token{};
+
+		promise_type() = default;
+
+		/// 参数中的 std::stop_token 优先，否则成员函数协程继承上游 Generator（第一个参数 *this）的 token
+		/// 成员函数协程的隐式对象参数会被推导成引用类型，所以要先去掉引用
+		template <typename TFirst, typename ...TArgs>
+		explicit promise_type(TFirst& first, TArgs&... args)
+			: token(FindStopToken(first, args...))
+		{
+			if constexpr (kIsGenerator<std::remove_cvref_t<TFirst>>)
+			{
+				if (!token.stop_possible() && first.handle)
+				{
+					token = first.handle.promise().token;
+				}
+			}
+		}
+
+		std::suspend_always initial_suspend() { return {}; };
+
+		std::suspend_always final_suspend() noexcept { return {}; };
+
+		std::suspend_always yield_value(const value_type& _value) requires (!std::is_reference_v<T>)
+		{
+			return store(_value, false);
+		}
+
+		std::suspend_always yield_value(value_type&& _value) requires (!std::is_reference_v<T>)
+		{
+			return store(_value, true);
+		}
+
+		std::suspend_always yield_value(T _value) requires std::is_reference_v<T>
+		{
+			return store(_value, false);
+		}
+
+		std::suspend_always store(const value_type& _value, bool _is_rvalue)
+		{
+			this->value = const_cast<value_type*>(std::addressof(_value));
+			is_rvalue = _is_rvalue;
+			is_ready = true;
+			return {};
+		}
+
+		/// co_yield 就不需要返回值了
+		void return_void() {};
+
+		void unhandled_exception() {};
+
+		Generator get_return_object()
+		{
+			return Generator{ std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+	};
+
+	/// 已经有值没有被消费时直接返回，否则恢复一次协程
+	/// 恢复后要么 co_yield 了新值（yield_value 会设置 is_ready），要么执行完了
+	bool has_next()
+	{
+		auto& promise = handle.promise();
+		if (promise.is_ready)
+		{
+			return true;
+		}
+		if (handle.done() || promise.token.stop_requested())
+		{
+			return false;
+		}
+		handle.resume();
+		return promise.is_ready;
+	}
+
+	/// 之后再创建的 map/filter 等 Generator 会继承这个 token
+	void set_stop_token(std::stop_token token)
+	{
+		handle.promise().token = std::move(token);
+	}
+
+	T next()
+	{
+		if (has_next())
+		{
+			auto& promise = handle.promise();
+			promise.is_ready = false;
+			if constexpr (std::is_reference_v<T>)
+			{
+				return static_cast<T>(*promise.value);
+			}
+			else
+			{
+				if (promise.is_rvalue)
+				{
+					return std::move(*promise.value);
+				}
+				return *promise.value;
+			}
+		}
+		throw ExhaustedException();
+	}
+
+	/// T []
+	/// int array[] = {1, 2, 3, 4}
+	/// auto gen = Generator<int>::from_array(array, 4)
+	Generator static from_array(value_type array[], int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			co_yield array[i];
+		}
+	}
+
+	/// list
+	/// auto gen = Generator<int>::from_list(std::list{1, 2, 3, 4});
+	Generator static from_list(std::list<value_type> list)
+	{
+		for (auto& t : list)
+		{
+			co_yield t;
+		}
+	}
+
+	/// initializer_list
+	/// auto gen = Generator<int>::from({1, 2, 3, 4})
+	Generator static from(std::initializer_list<value_type> args)
+	{
+		for (auto& t : args)
+		{
+			co_yield t;
+		}
+	}
+
+	/// fold expression C++17
+	/// 注意这里不要用递归去展开参数模板包
+	/// 不然会生成多个Generator对象
+	template<typename ...TArgs>
+	Generator static from(TArgs ...args)
+	{
+		(co_yield args, ...);
+	}
+
+	/// Monad
+	/// map and flat_map
+	/// map 就是将 Generator 当中的 T 映射成一个新的类型 U
+	/// 得到一个新的 Generator<U> 
+	template <typename U>
+	Generator<U> map(std::function<U(T)> f)
+	{
+		/// 判断this当中是否有下一个元素
+		while (has_next())
+		{
+			/// 通过 f 将其变成 U 类型的值，再使用 co_yield 传出
+			co_yield f(next());
+		}
+	}
+
+	/// 利用 std::invoke_result_t C++17
+	/// std::invoke_result_t 可以用来获取调用给定函数对象挥着函数指针时的返回类型
+	/// 它接受一个可调用对象（函数指针、函数对象、成员函数指针等）和一组参数类型
+	template<typename F>
+	Generator<std::invoke_result_t<F, T>> map(F f)
+	{
+		while (has_next())
+		{
+			/// 将 Generator 值的类型从 T 映射到 U
+			co_yield f(next());
+		}
+	}
+
+
+	/// flat_map
+	/// 前面提到的 map 是元素到元素的映射，而 flap_map 是元素到 Generator 的映射
+	/// 然后将这些映射之后的 Generator 再展开，组合成一个新的 Generator
+	/// 例如如果一个Generator会传出5个值，那么这5个值每一个值都会映射成一个新的 Generator
+	/// 得到的这5个Generator又会整合成一个新的 Generator
+	
+	template<typename F>
+	std::invoke_result_t<F, T> flat_map(F f) /// 这里的这个返回值必须显示的写出来
+	{
+		while (has_next())
+		{
+			/// 值映射成新的 Generator
+			auto gen = f(next());
+			/// 将新的 Generator 展开
+			while (gen.has_next())
+			{
+				/// 产生更多的 Generator
+				co_yield gen.next();
+			}
+		}
+	}
+
+	/// map 和 flat_map 的区别就是对原来元素的处理逻辑不同
+
+	/// 折叠函数，对多个值进行一个整体操作最终得到一个值
+	template<typename R, typename F>
+	R fold(R initial, F f)
+	{
+		R acc = initial;
+		while (has_next())
+		{
+			acc = f(acc, next());
+		}
+		return acc;
+	}
+
+	/// 过滤函数
+	template <typename F>
+	Generator filter(F f)
+	{
+		while (has_next())
+		{
+			T value = next();
+			if (f(value))
+			{
+				/// 值模式下把局部变量移动出去，引用模式下原样传出引用
+				co_yield std::forward<T>(value);
+			}
+		}
+	}
+
+	/// 提取前n个值
+	Generator take(int n)
+	{
+		int i = 0;
+		while (i++ < n && has_next())
+		{
+			co_yield next();
+		}
+	}
+
+	/// 提取到指定条件
+	template <typename F>
+	Generator take_while(F f)
+	{
+		while (has_next())
+		{
+			T value = next();
+			if (f(value))
+			{
+				/// 值模式下把局部变量移动出去，引用模式下原样传出引用
+				co_yield std::forward<T>(value);
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	/// 遍历所有的值，消费生成的 Generator
+	template<typename F>
+	void for_each(F f)
+	{
+		while (has_next())
+		{
+			f(next());
+		}
+	}
+
+
+	/// ---------- Iterator ----------
+	/// 满足 std::input_iterator，Generator 因此是一个 std::ranges::input_range
+	/// 可以直接用在 range-for 和 std::ranges::views 中
+	///		for (auto i : fibonacci() | std::views::take(10)) { ... }
+	/// 迭代器只做 resume 和 done 判断，不需要 has_next 里 is_ready 的那些额外判断
+	/// 但取值和前进都要清掉 is_ready，range-for 中途 break 之后 has_next()/next() 才不会再返回一次同一个值
+	using reference = std::conditional_t<std::is_reference_v<T>, T, const value_type&>;
+
+	class iterator
+	{
+	public:
+		using value_type = Generator::value_type;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() = default;
+
+		explicit iterator(std::coroutine_handle<promise_type> handle) noexcept
+			: m_coroHandle(handle) {};
+
+		reference operator*() const
+		{
+			auto& promise = m_coroHandle.promise();
+			promise.is_ready = false;
+			return static_cast<reference>(*promise.value);
+		}
+
+		iterator& operator++()
+		{
+			m_coroHandle.promise().is_ready = false;
+			m_coroHandle.resume();
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			++*this;
+		}
+
+		friend bool operator==(const iterator& it, std::default_sentinel_t)
+		{
+			return it.m_coroHandle.done() || it.m_coroHandle.promise().token.stop_requested();
+		}
+
+	private:
+		std::coroutine_handle<promise_type> m_coroHandle{};
+	};
+
+	/// 和 has_next()/next() 一样，先看看有没有还没被消费的值
+	iterator begin()
+	{
+		auto& promise = handle.promise();
+		if (!promise.is_ready && !handle.done() && !promise.token.stop_requested())
+		{
+			handle.resume();
+		}
+		return iterator{ handle };
+	}
+
+	std::default_sentinel_t end()
+	{
+		return {};
+	}
+
+	/// 最多取 n 个值放进 vector
+	/// 之后可以交给 std::execution::par 之类的并行算法
+	///		auto values = gen.to_vector(4096);
+	///		std::for_each(std::execution::par, values.begin(), values.end(), f);
+	std::vector<value_type> to_vector(std::size_t n = std::numeric_limits<std::size_t>::max())
+	{
+		std::vector<value_type> values;
+		for (std::size_t i = 0; i < n && has_next(); ++i)
+		{
+			values.push_back(next());
+		}
+		return values;
+	}
+
+
+	/// ---------- Prefetch ----------
+	/// 上游的值通常是在消费者调用 has_next() 时才在消费者的线程上计算出来的
+	/// 上游很慢时（例如解析数据的 flat_map），消费者每取一个值都要停下来等
+	/// prefetch 把上游交给 executor 在后台提前计算，最多缓存 n 个值，生产和消费同时进行
+	///		auto gen = lines.flat_map(Parse).prefetch(64, WorkStealingExecutor::Shared());
+	///		while (gen.has_next()) { Consume(gen.next()); }
+	/// 消费者看到的接口不变，缓冲区空时阻塞等待
+	/// 阻塞的是消费者所在的线程，所以消费者不能运行在 executor 的工作线程上（例如同一个调度器上的 Task）
+	/// 重新调度的后台任务可能正排在这个线程的 LIFO 槽位或者本地队列里，只有一个工作线程时必然死锁
+	/// Debug 构建下会检查 executor.IsInWorkerThread()
+	/// 缓冲区满时后台任务直接返回，不占用调度器的线程，消费者消耗到一半时再重新调度它
+	/// 上游任何时候都只在一个线程上恢复，只是不一定是消费者的线程
+	/// 值是复制（移动）出来的，所以 Generator<const T&> 得到的是 Generator<T>
+	Generator<value_type> prefetch(std::size_t n, AbstractExecutor& executor)
+	{
+		auto pState = std::make_shared<PrefetchState>(n, executor, *this);
+		// 析构时（遍历结束或者提前销毁）停止后台任务，等它不再访问上游
+		PrefetchGuard guard{ pState.get() };
+		pState->Schedule();
+		while (auto pValue = pState->Next())
+		{
+			co_yield std::move(*pValue);
+			pState->Consumed();
+		}
+	}
+
+
+	/// prefetch 的共享状态，后台任务持有一份引用，上游的协程帧销毁后它仍然有效
+	/// 两处交接都是同一个模式：一方先写自己的位置再检查对方的标记，另一方先挂标记再检查位置，中间都有 seq_cst fence
+	/// 这样至少有一方能看到对方，不会两边都睡着
+	struct PrefetchState : public std::enable_shared_from_this<PrefetchState>
+	{
+		PrefetchState(std::size_t n, AbstractExecutor& executor, Generator& upstream)
+			: ring(n), lowWatermark(ring.Capacity() / 2), executor(&executor), upstream(&upstream) {}
+
+		SpscRing<value_type> ring;
+		/// 缓冲区满了后台任务就退出，消费者把它消耗到只剩这么多时才重新调度
+		/// 每次调度至少能生产半个缓冲区，而不是腾出一个位置就调度一次
+		const std::size_t lowWatermark;
+		AbstractExecutor* executor;
+		Generator* upstream;
+		/// 消费者在 waiting 为 true 时在它上面等待，生产者只在 waiting 为 true 时才加一并唤醒
+		std::atomic<std::uint32_t> events{ 0 };
+		/// 消费者因为缓冲区空了准备睡眠
+		std::atomic<bool> waiting{ false };
+		/// 后台任务因为缓冲区满了而退出
+		std::atomic<bool> parked{ false };
+		std::atomic<bool> done{ false };
+		std::atomic<bool> stopped{ false };
+		/// 已经调度还没有退出的后台任务个数
+		std::atomic<int> active{ 0 };
+
+		void Schedule()
+		{
+			active.fetch_add(1, std::memory_order_relaxed);
+			executor->Execute([pState = this->shared_from_this()]() {
+				pState->Produce();
+				});
+		}
+
+		void Produce()
+		{
+			while (true)
+			{
+				while (!ring.Full())
+				{
+					if (stopped.load(std::memory_order_relaxed) || !upstream->has_next())
+					{
+						done.store(true, std::memory_order_seq_cst);
+						Wake();
+						Leave();
+						return;
+					}
+					ring.Push(upstream->next());
+					Wake();
+				}
+				parked.store(true, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				// 消费者可能在挂标记之前就已经消耗到水位线以下了，它不会再检查标记，这时要自己取回来接着生产
+				// 标记已经被消费者取走的话，由它重新调度的那个任务继续
+				if (ring.Size() > lowWatermark || !parked.exchange(false, std::memory_order_acq_rel))
+				{
+					Leave();
+					return;
+				}
+			}
+		}
+
+		/// 消费者：取下一个值，缓冲区空时等待，上游结束后返回 nullptr
+		value_type* Next()
+		{
+			while (true)
+			{
+				if (auto pValue = ring.Front())
+				{
+					return pValue;
+				}
+				if (done.load(std::memory_order_acquire))
+				{
+					// 结束之前放入的值
+					return ring.Front();
+				}
+				// 先读计数再挂标记，生产者看到标记之后的加一一定改变这里读到的值，wait 不会错过
+				auto nEvents = events.load(std::memory_order_relaxed);
+				waiting.store(true, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (ring.Front() || done.load(std::memory_order_acquire))
+				{
+					waiting.store(false, std::memory_order_relaxed);
+					continue;
+				}
+				assert(!executor->IsInWorkerThread() && "prefetch consumer must not block a worker of its own executor");
+				events.wait(nEvents, std::memory_order_acquire);
+			}
+		}
+
+		/// 消费者：值已经取走了，交还槽位，消耗到水位线时重新调度后台任务
+		void Consumed()
+		{
+			ring.Pop();
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (parked.load(std::memory_order_relaxed) && ring.Size() <= lowWatermark
+				&& parked.exchange(false, std::memory_order_acq_rel))
+			{
+				Schedule();
+			}
+		}
+
+		/// 生产者：放入值或者结束之后调用，消费者没有在等待时只有一次 fence 和一次读
+		void Wake()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false, std::memory_order_acq_rel))
+			{
+				events.fetch_add(1, std::memory_order_release);
+				events.notify_one();
+			}
+		}
+
+		void Leave()
+		{
+			active.fetch_sub(1, std::memory_order_release);
+			active.notify_all();
+		}
+	};
+
+	struct PrefetchGuard
+	{
+		PrefetchState* state;
+
+		~PrefetchGuard()
+		{
+			state->stopped.store(true, std::memory_order_relaxed);
+			auto nActive = state->active.load(std::memory_order_acquire);
+			while (nActive != 0)
+			{
+				state->active.wait(nActive, std::memory_order_acquire);
+				nActive = state->active.load(std::memory_order_acquire);
+			}
+		}
+	};
+
+
+	explicit Generator(std::coroutine_handle<promise_type> handle) noexcept
+		: handle(handle) {}
+
+	Generator(Generator&& generator) noexcept
+		: handle(std::exchange(generator.handle, {})) {}
+
+	/// 支持移动赋值，右值 Generator 才能直接用在 std::views 中（std::ranges::owning_view）
+	Generator& operator=(Generator&& generator) noexcept
+	{
+		if (this != &generator)
+		{
+			if (handle) handle.destroy();
+			handle = std::exchange(generator.handle, {});
+		}
+		return *this;
+	}
+
+	Generator(Generator&) = delete;
+	Generator& operator=(Generator&) = delete;
+
+	~Generator()
+	{
+		if (handle) handle.destroy();
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "FrameAllocator.h"
+#include "Generator.h"
+
+/// 按块传值的 Generator
+/// Generator<T> 每次 co_yield 只传出一个值，每个元素都要经历一次完整的挂起和恢复
+/// 元素很多的时候，这部分开销远大于处理元素本身
+/// GeneratorChunk<T> 每次传出一个 std::span<const T>，一次恢复处理一整块（默认 256 个）
+/// map/filter/fold 在块内部就是普通的循环，编译器可以直接向量化
+
+/// 传出的 span 指向协程帧中的缓冲区（或者原始数组），只在下一次 has_next() 之前有效
+/// 块大小为 0 时按 1 处理
+/// map/filter 是成员函数协程，帧里保存的是 this
+/// 左值上调用时上游必须比新的 GeneratorChunk 活得久；在临时对象上调用时会先把上游移动进新的协程帧
+///		auto chunks = GeneratorChunk<int>::from(Range(n));
+///		auto squares = chunks.map(Square);							// chunks 要一直有效
+///		auto evens = GeneratorChunk<int>::from(Range(n)).filter(IsEven);	// 上游归 evens 所有
+
+/// 块缓冲区
+/// std::vector<bool> 是按位存储的，不能转成 std::span<const bool>
+/// 能平凡默认构造的类型（包括 bool）都用这块只增不减的数组，按下标写入；其余的类型仍然用 std::vector
+template <typename T>
+class ChunkStorage
+{
+public:
+	// 至少能放下 n 个元素，内容未初始化
+	T* acquire(std::size_t n)
+	{
+		if (n > capacity)
+		{
+			data = std::make_unique_for_overwrite<T[]>(n);
+			capacity = n;
+		}
+		return data.get();
+	}
+
+private:
+	std::unique_ptr<T[]> data;
+	std::size_t capacity = 0;
+};
+
+template <typename T>
+inline constexpr bool kUseChunkStorage = std::is_trivially_default_constructible_v<T> && std::is_copy_assignable_v<T>;
+
+template <typename T>
+struct GeneratorChunk
+{
+	static constexpr std::size_t kDefaultChunkSize = 256;
+
+	class ExhaustedException : public std::exception {};
+
+	struct promise_type : public PooledPromise
+	{
+		std::span<const T> value{};
+		bool is_ready = false;
+
+		std::suspend_always initial_suspend() { return {}; };
+
+		std::suspend_always final_suspend() noexcept { return {}; };
+
+		std::suspend_always yield_value(std::span<const T> _value)
+		{
+			this->value = _value;
+			is_ready = true;
+			return {};
+		}
+
+		void return_void() {};
+
+		void unhandled_exception() {};
+
+		GeneratorChunk get_return_object()
+		{
+			return GeneratorChunk{ std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+	};
+
+	bool has_next()
+	{
+		if (handle.done())
+		{
+			return false;
+		}
+		if (!handle.promise().is_ready)
+		{
+			handle.resume();
+		}
+		return !handle.done();
+	}
+
+	std::span<const T> next()
+	{
+		if (has_next())
+		{
+			handle.promise().is_ready = false;
+			return handle.promise().value;
+		}
+		throw ExhaustedException();
+	}
+
+	/// 直接按块切分数组，不需要复制
+	/// auto gen = GeneratorChunk<int>::from_array(array, n)
+	GeneratorChunk static from_array(const T array[], std::size_t n, std::size_t chunkSize = kDefaultChunkSize)
+	{
+		chunkSize = std::max<std::size_t>(chunkSize, 1);
+		for (std::size_t i = 0; i < n; i += chunkSize)
+		{
+			co_yield std::span<const T>(array + i, std::min(chunkSize, n - i));
+		}
+	}
+
+	/// 把逐个传值的 Generator 攒成块
+	/// 上游仍然是逐个恢复的，但下游的所有阶段都按块执行
+	GeneratorChunk static from(Generator<T> gen, std::size_t chunkSize = kDefaultChunkSize)
+	{
+		chunkSize = std::max<std::size_t>(chunkSize, 1);
+		if constexpr (kUseChunkStorage<T>)
+		{
+			ChunkStorage<T> storage;
+			auto buffer = storage.acquire(chunkSize);
+			std::size_t n = 0;
+			while (gen.has_next())
+			{
+				buffer[n++] = gen.next();
+				if (n == chunkSize)
+				{
+					co_yield std::span<const T>(buffer, n);
+					n = 0;
+				}
+			}
+			if (n > 0)
+			{
+				co_yield std::span<const T>(buffer, n);
+			}
+		}
+		else
+		{
+			std::vector<T> buffer;
+			buffer.reserve(chunkSize);
+			while (gen.has_next())
+			{
+				buffer.push_back(gen.next());
+				if (buffer.size() == chunkSize)
+				{
+					co_yield std::span<const T>(buffer);
+					buffer.clear();
+				}
+			}
+			if (!buffer.empty())
+			{
+				co_yield std::span<const T>(buffer);
+			}
+		}
+	}
+
+	/// 块内逐个映射，输出写进同样大小的缓冲区
+	/// 和 Generator::map 一样不要求 U 能默认构造，f 返回引用时块里存的是复制出来的值
+	/// 能平凡默认构造的类型（int、float、bool 之类）按下标赋值，循环里没有容量检查，编译器可以向量化
+	template<typename F>
+	GeneratorChunk<std::remove_cvref_t<std::invoke_result_t<F, const T&>>> map(F f) &
+	{
+		using U = std::remove_cvref_t<std::invoke_result_t<F, const T&>>;
+		std::conditional_t<kUseChunkStorage<U>, ChunkStorage<U>, std::vector<U>> storage;
+		while (has_next())
+		{
+			auto chunk = next();
+			if constexpr (kUseChunkStorage<U>)
+			{
+				auto buffer = storage.acquire(chunk.size());
+				for (std::size_t i = 0; i < chunk.size(); ++i)
+				{
+					buffer[i] = f(chunk[i]);
+				}
+				co_yield std::span<const U>(buffer, chunk.size());
+			}
+			else
+			{
+				storage.clear();
+				storage.reserve(chunk.size());
+				for (const auto& value : chunk)
+				{
+					storage.emplace_back(f(value));
+				}
+				co_yield std::span<const U>(storage);
+			}
+		}
+	}
+
+	/// 块内过滤，过滤后为空的块直接跳过
+	/// 能平凡默认构造的类型先无条件写入再根据条件移动下标，循环里没有分支，其余的类型逐个 push_back
+	template <typename F>
+	GeneratorChunk filter(F f) &
+	{
+		std::conditional_t<kUseChunkStorage<T>, ChunkStorage<T>, std::vector<T>> storage;
+		while (has_next())
+		{
+			auto chunk = next();
+			const T* buffer = nullptr;
+			std::size_t n = 0;
+			if constexpr (kUseChunkStorage<T>)
+			{
+				auto output = storage.acquire(chunk.size());
+				for (std::size_t i = 0; i < chunk.size(); ++i)
+				{
+					output[n] = chunk[i];
+					n += static_cast<bool>(f(chunk[i]));
+				}
+				buffer = output;
+			}
+			else
+			{
+				storage.clear();
+				storage.reserve(chunk.size());
+				for (const auto& value : chunk)
+				{
+					if (f(value))
+					{
+						storage.push_back(value);
+					}
+				}
+				buffer = storage.data();
+				n = storage.size();
+			}
+			if (n > 0)
+			{
+				co_yield std::span<const T>(buffer, n);
+			}
+		}
+	}
+
+	/// 临时对象上的 map/filter，上游作为参数移动进新的协程帧，再在帧里调用左值版本
+	/// 每块多一次恢复，相对一整块的处理可以忽略
+	template<typename F>
+	GeneratorChunk<std::remove_cvref_t<std::invoke_result_t<F, const T&>>> map(F f) &&
+	{
+		return owning(std::move(*this), [f = std::move(f)](GeneratorChunk& upstream) mutable {
+			return upstream.map(std::move(f));
+			});
+	}
+
+	template <typename F>
+	GeneratorChunk filter(F f) &&
+	{
+		return owning(std::move(*this), [f = std::move(f)](GeneratorChunk& upstream) mutable {
+			return upstream.filter(std::move(f));
+			});
+	}
+
+	template <typename Stage>
+	static std::invoke_result_t<Stage&, GeneratorChunk&> owning(GeneratorChunk upstream, Stage stage)
+	{
+		auto gen = stage(upstream);
+		while (gen.has_next())
+		{
+			co_yield gen.next();
+		}
+	}
+
+	/// 折叠函数，每块只恢复一次，块内是普通的累加循环
+	template<typename R, typename F>
+	R fold(R initial, F f)
+	{
+		R acc = initial;
+		while (has_next())
+		{
+			for (const auto& value : next())
+			{
+				acc = f(acc, value);
+			}
+		}
+		return acc;
+	}
+
+	/// 逐块消费
+	template<typename F>
+	void for_each_chunk(F f)
+	{
+		while (has_next())
+		{
+			f(next());
+		}
+	}
+
+	/// 逐个消费
+	template<typename F>
+	void for_each(F f)
+	{
+		while (has_next())
+		{
+			for (const auto& value : next())
+			{
+				f(value);
+			}
+		}
+	}
+
+
+	explicit GeneratorChunk(std::coroutine_handle<promise_type> handle) noexcept
+		: handle(handle) {}
+
+	GeneratorChunk(GeneratorChunk&& generator) noexcept
+		: handle(std::exchange(generator.handle, {})) {}
+
+	GeneratorChunk(GeneratorChunk&) = delete;
+	GeneratorChunk& operator=(GeneratorChunk&) = delete;
+
+	~GeneratorChunk()
+	{
+		if (handle) handle.destroy();
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Generator.h"
+
+/// 文件的 Generator 源和输出
+/// from_array/from_list 都要求数据先放进内存，几个 GB 的日志不可能先读进一个 std::list
+/// 这里把文件映射到内存，直接传出指向映射区域的 std::string_view/std::span，不复制
+/// 映射时用 madvise(MADV_SEQUENTIAL) 告诉内核是顺序读取，内核会更积极地预读，读过的页也更早回收
+///
+///		MappedFile file("access.log");
+///		mapped_lines(file)
+///			.filter([](std::string_view line) { return line.contains(" 500 "); })
+///			.for_each(std::ref(sink));
+///
+/// 传出的视图指向映射区域，在 MappedFile 销毁之前一直有效，不受 has_next()/next() 的影响
+/// read_lines/read_records 把 MappedFile 放在协程帧里，视图在 Generator 销毁之前有效
+
+/// ---------- Mapped File ----------
+/// 只读映射整个文件，打开或者映射失败时抛出 std::system_error
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "open " + path);
+		}
+		struct stat st{};
+		if (::fstat(fd, &st) != 0)
+		{
+			int nError = errno;
+			::close(fd);
+			throw std::system_error(nError, std::system_category(), "fstat " + path);
+		}
+		m_nSize = static_cast<std::size_t>(st.st_size);
+		// 长度为 0 时 mmap 会失败，空文件就是一个空的视图
+		if (m_nSize > 0)
+		{
+			auto pData = ::mmap(nullptr, m_nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (pData == MAP_FAILED)
+			{
+				int nError = errno;
+				::close(fd);
+				throw std::system_error(nError, std::system_category(), "mmap " + path);
+			}
+			m_pData = static_cast<const char*>(pData);
+			// 只是建议，失败了也不影响读取
+			::madvise(pData, m_nSize, MADV_SEQUENTIAL);
+		}
+		// 映射建立之后就不再需要文件描述符了
+		::close(fd);
+	}
+
+	MappedFile(MappedFile&& file) noexcept
+		: m_pData(std::exchange(file.m_pData, nullptr)), m_nSize(std::exchange(file.m_nSize, 0)) {};
+
+	MappedFile& operator=(MappedFile&& file) noexcept
+	{
+		if (this != &file)
+		{
+			Unmap();
+			m_pData = std::exchange(file.m_pData, nullptr);
+			m_nSize = std::exchange(file.m_nSize, 0);
+		}
+		return *this;
+	}
+
+	MappedFile(MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&) = delete;
+
+	~MappedFile()
+	{
+		Unmap();
+	}
+
+	std::size_t Size() const noexcept { return m_nSize; }
+
+	std::string_view Text() const noexcept
+	{
+		return { m_pData, m_nSize };
+	}
+
+	std::span<const std::byte> Bytes() const noexcept
+	{
+		return { reinterpret_cast<const std::byte*>(m_pData), m_nSize };
+	}
+
+private:
+	void Unmap() noexcept
+	{
+		if (m_pData != nullptr)
+		{
+			::munmap(const_cast<char*>(m_pData), m_nSize);
+			m_pData = nullptr;
+		}
+	}
+
+private:
+	const char* m_pData = nullptr;
+	std::size_t m_nSize = 0;
+};
+
+/// ---------- Sources ----------
+/// 按 '\n' 切分的每一行，不包含换行符；最后一行没有换行符时也会传出
+inline Generator<std::string_view> mapped_lines(const MappedFile& file)
+{
+	auto text = file.Text();
+	auto pBegin = text.data();
+	auto pEnd = pBegin + text.size();
+	while (pBegin != pEnd)
+	{
+		auto pNewLine = static_cast<const char*>(std::memchr(pBegin, '\n', pEnd - pBegin));
+		auto pLineEnd = pNewLine != nullptr ? pNewLine : pEnd;
+		co_yield std::string_view(pBegin, pLineEnd - pBegin);
+		pBegin = pNewLine != nullptr ? pNewLine + 1 : pEnd;
+	}
+}
+
+/// 固定大小的记录，文件末尾不足一条的部分会被丢弃
+inline Generator<std::span<const std::byte>> mapped_records(const MappedFile& file, std::size_t nRecordSize)
+{
+	auto bytes = file.Bytes();
+	if (nRecordSize == 0)
+	{
+		co_return;
+	}
+	for (std::size_t i = 0; i + nRecordSize <= bytes.size(); i += nRecordSize)
+	{
+		co_yield bytes.subspan(i, nRecordSize);
+	}
+}
+
+/// 映射放在协程帧里，Generator 销毁时解除映射
+inline Generator<std::string_view> read_lines(std::string path)
+{
+	MappedFile file(path);
+	auto lines = mapped_lines(file);
+	while (lines.has_next())
+	{
+		co_yield lines.next();
+	}
+}
+
+inline Generator<std::span<const std::byte>> read_records(std::string path, std::size_t nRecordSize)
+{
+	MappedFile file(path);
+	auto records = mapped_records(file, nRecordSize);
+	while (records.has_next())
+	{
+		co_yield records.next();
+	}
+}
+
+/// ---------- Sink ----------
+/// 带缓冲区的输出，攒满一块才调用一次 write
+/// 不能复制，交给 for_each 时用 std::ref：
+///		BufferedFileSink sink("errors.log");
+///		lines.for_each(std::ref(sink));
+/// 析构时写出剩下的数据，析构时的写入错误会被忽略，需要知道结果时先调用 Flush()
+/// Flush 抛出异常时还没有写出去的数据留在缓冲区里，可以再调用一次 Flush 重试
+class BufferedFileSink
+{
+public:
+	static constexpr std::size_t kDefaultBufferSize = 64 * 1024;
+
+	explicit BufferedFileSink(const std::string& path, std::size_t nBufferSize = kDefaultBufferSize)
+		: BufferedFileSink(nBufferSize)
+	{
+		m_nFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (m_nFd < 0)
+		{
+			throw std::system_error(errno, std::system_category(), "open " + path);
+		}
+		m_bOwnsFd = true;
+	}
+
+	// 写到已经打开的文件描述符（例如 STDOUT_FILENO），不负责关闭
+	explicit BufferedFileSink(int fd, std::size_t nBufferSize = kDefaultBufferSize)
+		: BufferedFileSink(nBufferSize)
+	{
+		m_nFd = fd;
+	}
+
+	BufferedFileSink(BufferedFileSink&) = delete;
+	BufferedFileSink& operator=(BufferedFileSink&) = delete;
+
+	~BufferedFileSink()
+	{
+		try
+		{
+			Flush();
+		}
+		catch (std::system_error&)
+		{
+		}
+		if (m_bOwnsFd)
+		{
+			::close(m_nFd);
+		}
+	}
+
+	void Write(std::string_view data)
+	{
+		if (data.size() > m_nCapacity - m_nSize)
+		{
+			Flush();
+			// 比整个缓冲区还大的数据直接写出去，不再复制一次
+			if (data.size() >= m_nCapacity)
+			{
+				int nError = 0;
+				if (WriteAll(data.data(), data.size(), nError) < data.size())
+				{
+					throw std::system_error(nError, std::system_category(), "write");
+				}
+				return;
+			}
+		}
+		std::memcpy(m_pBuffer.get() + m_nSize, data.data(), data.size());
+		m_nSize += data.size();
+	}
+
+	void Write(std::span<const std::byte> data)
+	{
+		Write(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()));
+	}
+
+	void WriteLine(std::string_view line)
+	{
+		Write(line);
+		Write(std::string_view("\n", 1));
+	}
+
+	// for_each 的回调：文本按行写出，记录原样写出
+	void operator()(std::string_view line)
+	{
+		WriteLine(line);
+	}
+
+	void operator()(std::span<const std::byte> record)
+	{
+		Write(record);
+	}
+
+	void Flush()
+	{
+		if (m_nSize == 0)
+		{
+			return;
+		}
+		int nError = 0;
+		auto nWritten = WriteAll(m_pBuffer.get(), m_nSize, nError);
+		// 只丢掉确实写出去的部分，剩下的移到缓冲区开头
+		m_nSize -= nWritten;
+		if (m_nSize > 0)
+		{
+			std::memmove(m_pBuffer.get(), m_pBuffer.get() + nWritten, m_nSize);
+			throw std::system_error(nError, std::system_category(), "write");
+		}
+	}
+
+private:
+	explicit BufferedFileSink(std::size_t nBufferSize)
+		: m_nCapacity(nBufferSize > 0 ? nBufferSize : 1), m_pBuffer(new char[m_nCapacity]) {};
+
+	// 返回写出去的字节数，小于 nSize 时 nError 是失败的原因
+	std::size_t WriteAll(const char* pData, std::size_t nSize, int& nError) noexcept
+	{
+		std::size_t nWritten = 0;
+		while (nWritten < nSize)
+		{
+			auto n = ::write(m_nFd, pData + nWritten, nSize - nWritten);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				nError = errno;
+				break;
+			}
+			nWritten += static_cast<std::size_t>(n);
+		}
+		return nWritten;
+	}
+
+private:
+	int m_nFd = -1;
+	bool m_bOwnsFd = false;
+	std::size_t m_nCapacity;
+	std::unique_ptr<char[]> m_pBuffer;
+	std::size_t m_nSize = 0;
+};
+
+#endif
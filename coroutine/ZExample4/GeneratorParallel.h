@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Generator.h"
+#include "Task.h"
+#include "WhenAll.h"
+
+/// 并行折叠
+/// Generator::fold 在调用方的线程上逐个累加，数据量很大的时候其他的核都闲着
+/// parallel_fold 把数据切成若干块，每一块在自己的 Task 里折叠，最后按顺序合并：
+///		auto sum = parallel_fold(executor, std::span(values), 0L,
+///			[](long acc, int i) { return acc + i; },
+///			[](long a, long b) { return a + b; }).GetResult();
+/// 每一块都从 initial 开始折叠，所以 initial 必须是 combine 的单位元（求和就是 0，求积就是 1）
+/// 合并的顺序和数据的顺序一致，combine 只需要满足结合律，不需要满足交换律
+///
+///		1. 可以随机访问的数据（数组、vector、span）直接按下标切块，不需要复制
+///		2. Generator 只能在一个线程上逐个拉取，没有办法切分，这时改为流水线：
+///		   当前 Task 拉取一块就交给一个新的 Task 去折叠，自己接着拉取下一块，拉取和折叠同时进行
+///		   同时在折叠的块数有上限，超过时先等最早的一块完成并合并，内存占用不会随数据量增长
+///
+/// 传入的 Generator 和 Generator 的 map/filter 一样，不能比它引用的上游活得更久
+/// 通常在同一个表达式里直接 GetResult() 或者 co_await
+
+inline constexpr std::size_t kParallelFoldChunkSize = 4096;
+inline constexpr std::size_t kParallelFoldMaxInFlight = 8;
+
+namespace detail
+{
+	/// executor 只是交给 promise 选择调度器，函数体里用不到
+	template <typename T, typename R, typename F>
+	Task<R> FoldChunk([[maybe_unused]] AbstractExecutor& executor, std::span<const T> values, R initial, F f)
+	{
+		R acc = std::move(initial);
+		for (const auto& value : values)
+		{
+			acc = f(std::move(acc), value);
+		}
+		co_return acc;
+	}
+
+	/// 流水线模式下块的数据归 Task 所有
+	template <typename T, typename R, typename F>
+	Task<R> FoldOwnedChunk([[maybe_unused]] AbstractExecutor& executor, std::vector<T> values, R initial, F f)
+	{
+		R acc = std::move(initial);
+		for (auto& value : values)
+		{
+			acc = f(std::move(acc), std::move(value));
+		}
+		co_return acc;
+	}
+}
+
+/// ---------- Random Access ----------
+template <typename T, typename R, typename F, typename C>
+Task<R> parallel_fold(AbstractExecutor& executor, std::span<const T> values, R initial, F f, C combine,
+	std::size_t nChunkSize = kParallelFoldChunkSize)
+{
+	nChunkSize = std::max<std::size_t>(nChunkSize, 1);
+	std::vector<Task<R>> tasks;
+	tasks.reserve((values.size() + nChunkSize - 1) / nChunkSize);
+	for (std::size_t i = 0; i < values.size(); i += nChunkSize)
+	{
+		tasks.push_back(detail::FoldChunk(executor, values.subspan(i, std::min(nChunkSize, values.size() - i)), initial, f));
+	}
+	if (tasks.empty())
+	{
+		co_return initial;
+	}
+	auto results = co_await WhenAll(std::move(tasks));
+	R acc = std::move(results.front());
+	for (std::size_t i = 1; i < results.size(); ++i)
+	{
+		acc = combine(std::move(acc), std::move(results[i]));
+	}
+	co_return acc;
+}
+
+/// std::span(values) 在非 const 的 vector 或者数组上得到的是 std::span<int>（数组还带着固定的长度）
+/// 推导不出上面的 std::span<const T>，这里转换一下
+template <typename T, std::size_t N, typename R, typename F, typename C>
+Task<R> parallel_fold(AbstractExecutor& executor, std::span<T, N> values, R initial, F f, C combine,
+	std::size_t nChunkSize = kParallelFoldChunkSize)
+{
+	return parallel_fold(executor, std::span<const T>(values), std::move(initial), std::move(f), std::move(combine), nChunkSize);
+}
+
+template <typename T, typename R, typename F, typename C>
+Task<R> parallel_fold(AbstractExecutor& executor, const std::vector<T>& values, R initial, F f, C combine,
+	std::size_t nChunkSize = kParallelFoldChunkSize)
+{
+	return parallel_fold(executor, std::span<const T>(values), std::move(initial), std::move(f), std::move(combine), nChunkSize);
+}
+
+/// 和 Generator::from_array 对应
+template <typename T, typename R, typename F, typename C>
+Task<R> parallel_fold(AbstractExecutor& executor, const T array[], std::size_t n, R initial, F f, C combine,
+	std::size_t nChunkSize = kParallelFoldChunkSize)
+{
+	return parallel_fold(executor, std::span<const T>(array, n), std::move(initial), std::move(f), std::move(combine), nChunkSize);
+}
+
+/// ---------- Pipeline ----------
+template <typename T, typename R, typename F, typename C>
+Task<R> parallel_fold(AbstractExecutor& executor, Generator<T> gen, R initial, F f, C combine,
+	std::size_t nChunkSize = kParallelFoldChunkSize, std::size_t nMaxInFlight = kParallelFoldMaxInFlight)
+{
+	using TValue = typename Generator<T>::value_type;
+	nChunkSize = std::max<std::size_t>(nChunkSize, 1);
+	nMaxInFlight = std::max<std::size_t>(nMaxInFlight, 1);
+
+	R acc = initial;
+	std::deque<Task<R>> tasks;
+	while (gen.has_next())
+	{
+		std::vector<TValue> chunk;
+		chunk.reserve(nChunkSize);
+		while (chunk.size() < nChunkSize && gen.has_next())
+		{
+			chunk.push_back(gen.next());
+		}
+		tasks.push_back(detail::FoldOwnedChunk(executor, std::move(chunk), initial, f));
+		if (tasks.size() >= nMaxInFlight)
+		{
+			acc = combine(std::move(acc), co_await std::move(tasks.front()));
+			tasks.pop_front();
+		}
+	}
+	while (!tasks.empty())
+	{
+		acc = combine(std::move(acc), co_await std::move(tasks.front()));
+		tasks.pop_front();
+	}
+	co_return acc;
+}
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Generator.h"
+
+/// 融合的管道操作符
+/// Generator 的 filter().map().take() 每一步都会生成一个新的协程
+/// 一个元素从头走到尾，要经过每一层协程的挂起和恢复
+///
+/// 这里换一种写法：
+///		gen | fused::filter(f) | fused::map(g) | fused::take(n) | fused::for_each(h)
+/// 每个阶段只是一个普通的函数对象，在最后的终止操作处从后往前组合成一个回调（下游回调）
+/// 整条管道在编译期就被内联成一个循环：从 gen 取一个值，依次过滤、映射、计数
+/// 只有 flat_map 展开子 Generator 时才真正需要协程
+///
+/// 下游回调返回 bool，false 表示下游不再需要更多的值（例如 take 已经取够了），循环可以提前结束
+///
+/// 上游如果本身就是数组，用 fused::from(span) 代替 Generator::from_array，循环里就完全没有协程了
+
+namespace fused
+{
+	/// ---------- Sources ----------
+	/// 和 Generator 一样提供 has_next()/next()，但只是一个普通的下标
+	template <typename T>
+	class SpanSource
+	{
+	public:
+		explicit SpanSource(std::span<const T> values) noexcept
+			: m_spanValues(values) {};
+
+		bool has_next() const
+		{
+			return m_nIndex < m_spanValues.size();
+		}
+
+		const T& next()
+		{
+			return m_spanValues[m_nIndex++];
+		}
+
+	private:
+		std::span<const T> m_spanValues;
+		std::size_t m_nIndex = 0;
+	};
+
+	template <typename T>
+	SpanSource<T> from(std::span<const T> values) { return SpanSource<T>(values); }
+
+	template <typename T>
+	SpanSource<T> from(const std::vector<T>& values) { return SpanSource<T>(values); }
+
+	/// ---------- Stages ----------
+	/// 每个阶段提供：
+	///		kIsStage		用来识别阶段类型
+	///		Output<TIn>		输入类型为 TIn 时的输出类型
+	///		Bind(sink)		把下游回调包装成接收 TIn 的回调
+	///		IsDone()		可选，返回 true 表示一开始就不需要任何值，管道不会从上游拉取
+
+	template <typename F>
+	struct FilterStage
+	{
+		F m_funcPredicate;
+
+		static constexpr bool kIsStage = true;
+
+		template <typename TIn>
+		using Output = TIn;
+
+		template <typename TSink>
+		auto Bind(TSink sink)
+		{
+			return [f = m_funcPredicate, sink](auto&& value) mutable -> bool {
+				if (f(value))
+				{
+					return sink(std::forward<decltype(value)>(value));
+				}
+				return true;
+				};
+		}
+	};
+
+	template <typename F>
+	struct MapStage
+	{
+		F m_funcMapper;
+
+		static constexpr bool kIsStage = true;
+
+		template <typename TIn>
+		using Output = std::invoke_result_t<F, TIn>;
+
+		template <typename TSink>
+		auto Bind(TSink sink)
+		{
+			return [f = m_funcMapper, sink](auto&& value) mutable -> bool {
+				return sink(f(std::forward<decltype(value)>(value)));
+				};
+		}
+	};
+
+	struct TakeStage
+	{
+		std::size_t m_nCount;
+
+		static constexpr bool kIsStage = true;
+
+		template <typename TIn>
+		using Output = TIn;
+
+		// take(0) 在拉取第一个值之前就结束，上游一个值都不会产生
+		bool IsDone() const noexcept
+		{
+			return m_nCount == 0;
+		}
+
+		template <typename TSink>
+		auto Bind(TSink sink)
+		{
+			return [n = m_nCount, sink](auto&& value) mutable -> bool {
+				// 返回 false 之后上游不会再调用，这里只是保险
+				if (n == 0)
+				{
+					return false;
+				}
+				--n;
+				// 取够了就通知上游停下来，不会再多拉一个值
+				return sink(std::forward<decltype(value)>(value)) && n > 0;
+				};
+		}
+	};
+
+	template <typename F>
+	struct TakeWhileStage
+	{
+		F m_funcPredicate;
+
+		static constexpr bool kIsStage = true;
+
+		template <typename TIn>
+		using Output = TIn;
+
+		template <typename TSink>
+		auto Bind(TSink sink)
+		{
+			return [f = m_funcPredicate, sink](auto&& value) mutable -> bool {
+				if (!f(value))
+				{
+					return false;
+				}
+				return sink(std::forward<decltype(value)>(value));
+				};
+		}
+	};
+
+	/// flat_map 的 f 返回一个 Generator，这里是整条管道里唯一的协程边界
+	template <typename F>
+	struct FlatMapStage
+	{
+		F m_funcMapper;
+
+		static constexpr bool kIsStage = true;
+
+		template <typename TIn>
+		using Output = decltype(std::declval<std::invoke_result_t<F, TIn>&>().next());
+
+		template <typename TSink>
+		auto Bind(TSink sink)
+		{
+			return [f = m_funcMapper, sink](auto&& value) mutable -> bool {
+				auto gen = f(std::forward<decltype(value)>(value));
+				while (gen.has_next())
+				{
+					if (!sink(gen.next()))
+					{
+						return false;
+					}
+				}
+				return true;
+				};
+		}
+	};
+
+	/// ---------- Terminals ----------
+	template <typename F>
+	struct ForEachTerminal
+	{
+		F m_funcConsumer;
+	};
+
+	template <typename R, typename F>
+	struct FoldTerminal
+	{
+		R m_tInitial;
+		F m_funcFolder;
+	};
+
+	struct ToGeneratorTerminal {};
+
+	template <typename F>
+	FilterStage<F> filter(F f) { return { std::move(f) }; }
+
+	template <typename F>
+	MapStage<F> map(F f) { return { std::move(f) }; }
+
+	inline TakeStage take(std::size_t n) { return { n }; }
+
+	template <typename F>
+	TakeWhileStage<F> take_while(F f) { return { std::move(f) }; }
+
+	template <typename F>
+	FlatMapStage<F> flat_map(F f) { return { std::move(f) }; }
+
+	template <typename F>
+	ForEachTerminal<F> for_each(F f) { return { std::move(f) }; }
+
+	template <typename R, typename F>
+	FoldTerminal<R, F> fold(R initial, F f) { return { std::move(initial), std::move(f) }; }
+
+	/// 把融合后的管道重新包装成 Generator，只会产生这一个协程
+	inline ToGeneratorTerminal to_generator() { return {}; }
+
+	/// 沿着各个阶段推导出最终的元素类型
+	template <typename TIn, typename ...TStages>
+	struct PipelineOutput
+	{
+		using Type = TIn;
+	};
+
+	template <typename TIn, typename TStage, typename ...TStages>
+	struct PipelineOutput<TIn, TStage, TStages...>
+	{
+		using Type = typename PipelineOutput<typename TStage::template Output<TIn>, TStages...>::Type;
+	};
+
+	/// ---------- Pipeline ----------
+	/// TSource 是 Generator<T> 或者 SpanSource<T>
+	template <typename TSource, typename ...TStages>
+	class Pipeline
+	{
+		using source_type = decltype(std::declval<TSource&>().next());
+
+	public:
+		using value_type = std::remove_cvref_t<typename PipelineOutput<source_type, TStages...>::Type>;
+
+		Pipeline(TSource&& source, std::tuple<TStages...>&& stages)
+			: m_Source(std::move(source)), m_tupStages(std::move(stages)) {};
+
+		template <typename TStage>
+		Pipeline<TSource, TStages..., TStage> Append(TStage stage) &&
+		{
+			return Pipeline<TSource, TStages..., TStage>(std::move(m_Source),
+				std::tuple_cat(std::move(m_tupStages), std::make_tuple(std::move(stage))));
+		}
+
+		/// 把所有阶段组合成一个回调，然后用一个循环驱动上游
+		template <typename TSink>
+		void Run(TSink sink)
+		{
+			if (IsDone())
+			{
+				return;
+			}
+			auto fused = Compose<0>(std::move(sink));
+			while (m_Source.has_next())
+			{
+				if (!fused(m_Source.next()))
+				{
+					break;
+				}
+			}
+		}
+
+		/// 管道按值传进协程，保存在协程帧里，不依赖调用方的临时对象
+		static Generator<value_type> ToGenerator(Pipeline pipeline)
+		{
+			// 一个输入可能产生多个输出（flat_map），先放进缓冲区再逐个传出
+			std::vector<value_type> buffer;
+			auto fused = pipeline.template Compose<0>([&buffer](auto&& value) -> bool {
+				buffer.push_back(std::forward<decltype(value)>(value));
+				return true;
+				});
+			bool bMore = !pipeline.IsDone();
+			while (bMore && pipeline.m_Source.has_next())
+			{
+				bMore = fused(pipeline.m_Source.next());
+				for (auto& value : buffer)
+				{
+					co_yield std::move(value);
+				}
+				buffer.clear();
+			}
+		}
+
+	private:
+		/// 任何一个阶段已经不需要值了，整条管道都不需要，连上游的 has_next() 都不用调用
+		bool IsDone() const
+		{
+			return std::apply([](const auto& ...stages) {
+				return ([](const auto& stage) {
+					if constexpr (requires { stage.IsDone(); })
+					{
+						return stage.IsDone();
+					}
+					else
+					{
+						return false;
+					}
+					}(stages) || ...);
+				}, m_tupStages);
+		}
+
+		template <std::size_t I, typename TSink>
+		auto Compose(TSink sink)
+		{
+			if constexpr (I == sizeof...(TStages))
+			{
+				return sink;
+			}
+			else
+			{
+				return std::get<I>(m_tupStages).Bind(Compose<I + 1>(std::move(sink)));
+			}
+		}
+
+	private:
+		TSource m_Source;
+		std::tuple<TStages...> m_tupStages;
+	};
+
+	template <typename TStage>
+	concept Stage = TStage::kIsStage;
+
+	/// ---------- operator| ----------
+	template <typename T, Stage TStage>
+	Pipeline<Generator<T>, TStage> operator|(Generator<T>&& source, TStage stage)
+	{
+		return Pipeline<Generator<T>, TStage>(std::move(source), std::make_tuple(std::move(stage)));
+	}
+
+	template <typename T, Stage TStage>
+	Pipeline<SpanSource<T>, TStage> operator|(SpanSource<T> source, TStage stage)
+	{
+		return Pipeline<SpanSource<T>, TStage>(std::move(source), std::make_tuple(std::move(stage)));
+	}
+
+	template <typename TSource, typename ...TStages, Stage TStage>
+	Pipeline<TSource, TStages..., TStage> operator|(Pipeline<TSource, TStages...>&& pipeline, TStage stage)
+	{
+		return std::move(pipeline).Append(std::move(stage));
+	}
+
+	template <typename TSource, typename ...TStages, typename F>
+	void operator|(Pipeline<TSource, TStages...>&& pipeline, ForEachTerminal<F> terminal)
+	{
+		pipeline.Run([&terminal](auto&& value) -> bool {
+			terminal.m_funcConsumer(std::forward<decltype(value)>(value));
+			return true;
+			});
+	}
+
+	template <typename TSource, typename ...TStages, typename R, typename F>
+	R operator|(Pipeline<TSource, TStages...>&& pipeline, FoldTerminal<R, F> terminal)
+	{
+		R acc = std::move(terminal.m_tInitial);
+		pipeline.Run([&acc, &terminal](auto&& value) -> bool {
+			acc = terminal.m_funcFolder(std::move(acc), std::forward<decltype(value)>(value));
+			return true;
+			});
+		return acc;
+	}
+
+	template <typename TSource, typename ...TStages>
+	auto operator|(Pipeline<TSource, TStages...>&& pipeline, ToGeneratorTerminal)
+	{
+		return Pipeline<TSource, TStages...>::ToGenerator(std::move(pipeline));
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "Generator.h"
+
+/// 编译期的序列表
+/// ZExample2 的 fibonacci() 每一项都要恢复一次协程才能算出 a + b，而且 int 在第 46 项之后就溢出了
+/// 有界的序列完全可以在编译期算好放进一个静态数组，运行时只剩下按下标取值
+///
+///		constexpr auto f = FibonacciTable<std::uint64_t>::At(90);		// 编译期常量
+///		for (auto value : fibonacci_table<std::uint64_t>().take(10)) { ... }
+///
+/// TableGenerator<T> 和 Generator<T> 的用法一样（has_next/next/take/for_each/range-for/to_vector）
+/// 但只是在数组上移动一个指针，没有协程帧，也不会恢复任何协程
+/// 需要 map/filter 等组合子时用 generator() 转成一个普通的 Generator<T>
+
+/// ---------- Table ----------
+/// consteval 的生成器：第 i 项由前 i 项算出，f(std::span<const T>) 返回下一项
+template <typename T, std::size_t N, typename F>
+consteval std::array<T, N> MakeSequenceTable(F f)
+{
+	std::array<T, N> table{};
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		table[i] = f(std::span<const T>(table.data(), i));
+	}
+	return table;
+}
+
+/// 表中的值从 T 的最大值截断，所以要求 numeric_limits 有定义（__int128 在 -std=c++ 下不算 std::integral）
+template <typename T>
+concept SequenceInteger = std::numeric_limits<T>::is_specialized && std::numeric_limits<T>::is_integer;
+
+/// ---------- Generator Interface ----------
+/// 指向静态数组的 Generator，元素在整个程序运行期间一直有效
+template <typename T>
+class TableGenerator
+{
+public:
+	class ExhaustedException : public std::exception {};
+
+	using value_type = T;
+
+	constexpr explicit TableGenerator(std::span<const T> values) noexcept
+		: m_pCurrent(values.data()), m_pEnd(values.data() + values.size()) {};
+
+	constexpr bool has_next() const noexcept
+	{
+		return m_pCurrent != m_pEnd;
+	}
+
+	constexpr T next()
+	{
+		if (!has_next())
+		{
+			throw ExhaustedException();
+		}
+		return *m_pCurrent++;
+	}
+
+	/// 和 Generator::take 一样，不够 n 个时取到末尾为止
+	constexpr TableGenerator take(std::size_t n) const noexcept
+	{
+		return TableGenerator(std::span<const T>(m_pCurrent, std::min<std::size_t>(n, size())));
+	}
+
+	constexpr TableGenerator skip(std::size_t n) const noexcept
+	{
+		auto nSkip = std::min<std::size_t>(n, size());
+		return TableGenerator(std::span<const T>(m_pCurrent + nSkip, m_pEnd));
+	}
+
+	template<typename F>
+	constexpr void for_each(F f)
+	{
+		for (; m_pCurrent != m_pEnd; ++m_pCurrent)
+		{
+			f(*m_pCurrent);
+		}
+	}
+
+	template<typename R, typename F>
+	constexpr R fold(R initial, F f)
+	{
+		R acc = initial;
+		for (; m_pCurrent != m_pEnd; ++m_pCurrent)
+		{
+			acc = f(acc, *m_pCurrent);
+		}
+		return acc;
+	}
+
+	std::vector<T> to_vector(std::size_t n = std::numeric_limits<std::size_t>::max())
+	{
+		auto nCount = std::min(n, size());
+		std::vector<T> values(m_pCurrent, m_pCurrent + nCount);
+		m_pCurrent += nCount;
+		return values;
+	}
+
+	/// 转成普通的 Generator，接上 map/filter/prefetch 等组合子
+	/// 从这里开始每一项都要恢复一次协程，只在确实需要组合子时使用
+	/// 得到的 Generator 和当前对象互不影响，可以在临时对象上调用
+	Generator<T> generator() const
+	{
+		return generate(m_pCurrent, m_pEnd);
+	}
+
+	/// ---------- Iterator ----------
+	/// 直接是数组指针，满足 std::ranges::contiguous_range
+	constexpr const T* begin() const noexcept { return m_pCurrent; }
+	constexpr const T* end() const noexcept { return m_pEnd; }
+	constexpr std::size_t size() const noexcept { return static_cast<std::size_t>(m_pEnd - m_pCurrent); }
+
+private:
+	/// 不能写成成员协程：协程帧里只会保存 this，临时对象销毁之后就悬空了
+	/// 两个指针按值放进协程帧，指向的是静态数组
+	static Generator<T> generate(const T* pCurrent, const T* pEnd)
+	{
+		for (; pCurrent != pEnd; ++pCurrent)
+		{
+			co_yield *pCurrent;
+		}
+	}
+
+private:
+	const T* m_pCurrent;
+	const T* m_pEnd;
+};
+
+/// ---------- Fibonacci ----------
+/// T 能表示的所有斐波那契数：
+///		int				47 项（F0 ~ F46）
+///		std::uint64_t	94 项（F0 ~ F93）
+///		__int128		185 项（F0 ~ F184）
+///		unsigned __int128	187 项（F0 ~ F186）
+template <SequenceInteger T>
+struct FibonacciTable
+{
+	static consteval std::size_t Count()
+	{
+		T a = 0;
+		T b = 1;
+		std::size_t nCount = 2;
+		while (b <= std::numeric_limits<T>::max() - a)
+		{
+			T c = a + b;
+			a = b;
+			b = c;
+			++nCount;
+		}
+		return nCount;
+	}
+
+	static constexpr std::size_t kSize = Count();
+
+	static constexpr std::array<T, kSize> kTerms = MakeSequenceTable<T, kSize>([](std::span<const T> previous)
+		{
+			auto n = previous.size();
+			return n < 2 ? static_cast<T>(n) : static_cast<T>(previous[n - 1] + previous[n - 2]);
+		});
+
+	/// 第 n 项，n 必须小于 kSize
+	static constexpr T At(std::size_t n) noexcept
+	{
+		return kTerms[n];
+	}
+};
+
+/// 从第 nFirst 项开始的斐波那契数列，到 T 能表示的最后一项为止
+template <SequenceInteger T>
+constexpr TableGenerator<T> fibonacci_table(std::size_t nFirst = 0) noexcept
+{
+	return TableGenerator<T>(FibonacciTable<T>::kTerms).skip(nFirst);
+}
+
+using Fibonacci64 = FibonacciTable<std::uint64_t>;
+
+#if defined(__SIZEOF_INT128__)
+using Fibonacci128 = FibonacciTable<unsigned __int128>;
+#endif
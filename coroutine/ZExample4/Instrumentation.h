@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <utility>
+#include <vector>
+
+/// 协程运行时统计
+/// 编译时定义 CPPFEATURE_CORO_INSTRUMENTATION=1 打开，默认关闭，所有翻译单元必须一致
+/// 关闭时 TaskTrace 是空类型，钩子都是空的内联函数，await_transform 原样返回 Awaiter，没有任何额外开销
+///
+/// 打开后每个线程把数据记录在自己的 ThreadMetrics 里，只有自己写，其他线程只读，不需要加锁：
+///		StartDelay		Task 创建到第一次开始执行，也就是在调度器队列里等了多久（纳秒）
+///		Segment			每一段连续执行的时间，从恢复到下一次挂起（纳秒）
+///		Suspensions		每个 Task 从开始到完成一共挂起了几次
+///		QueueDepth		工作线程每次取任务时队列里还剩多少任务
+///		Resumes			恢复的次数
+/// CoroutineMetrics::Snapshot() 取得所有线程的直方图，Total() 合并成一份
+/// CoroutineMetrics::EnableTrace(true) 之后，每一段执行都记录成一个 Chrome trace 事件
+/// WriteChromeTrace 输出的 JSON 可以直接在 chrome://tracing 或者 Perfetto 中打开
+///
+///		CoroutineMetrics::EnableTrace(true);
+///		...
+///		auto total = CoroutineMetrics::Snapshot().Total();
+///		std::cout << total.m_Segment.Percentile(0.99) << std::endl;
+///		std::ofstream file("trace.json");
+///		CoroutineMetrics::WriteChromeTrace(file);
+
+#ifndef CPPFEATURE_CORO_INSTRUMENTATION
+#define CPPFEATURE_CORO_INSTRUMENTATION 0
+#endif
+
+inline constexpr bool kCoroutineInstrumentation = CPPFEATURE_CORO_INSTRUMENTATION != 0;
+
+/// ---------- Histogram ----------
+/// 按 2 的幂分桶：第 0 个桶只有 0，第 i 个桶是 [2^(i-1), 2^i)
+struct HistogramSnapshot
+{
+	static constexpr std::size_t kBucketCount = 65;
+
+	std::uint64_t m_nCount = 0;
+	std::uint64_t m_nSum = 0;
+	std::uint64_t m_nMax = 0;
+	std::array<std::uint64_t, kBucketCount> m_arrBuckets{};
+
+	double Mean() const
+	{
+		return m_nCount == 0 ? 0.0 : static_cast<double>(m_nSum) / static_cast<double>(m_nCount);
+	}
+
+	// 第 p 分位（0 到 1）所在的桶的上界，不超过最大值
+	std::uint64_t Percentile(double p) const
+	{
+		if (m_nCount == 0)
+		{
+			return 0;
+		}
+		auto nTarget = static_cast<std::uint64_t>(std::clamp(p, 0.0, 1.0) * static_cast<double>(m_nCount - 1)) + 1;
+		std::uint64_t nSeen = 0;
+		for (std::size_t i = 0; i < kBucketCount; ++i)
+		{
+			nSeen += m_arrBuckets[i];
+			if (nSeen >= nTarget)
+			{
+				auto nUpper = i == 0 ? 0 : i == 64 ? std::numeric_limits<std::uint64_t>::max() : (std::uint64_t{ 1 } << i) - 1;
+				return std::min(nUpper, m_nMax);
+			}
+		}
+		return m_nMax;
+	}
+
+	void Merge(const HistogramSnapshot& snapshot)
+	{
+		m_nCount += snapshot.m_nCount;
+		m_nSum += snapshot.m_nSum;
+		m_nMax = std::max(m_nMax, snapshot.m_nMax);
+		for (std::size_t i = 0; i < kBucketCount; ++i)
+		{
+			m_arrBuckets[i] += snapshot.m_arrBuckets[i];
+		}
+	}
+};
+
+/// 只有所属线程写入，所以用 load + store 代替 fetch_add，不需要带 lock 前缀的指令
+/// 其他线程随时可以读，读到的是某个时刻附近的值
+class Histogram
+{
+public:
+	void Record(std::uint64_t nValue) noexcept
+	{
+		Add(m_arrBuckets[std::bit_width(nValue)], 1);
+		Add(m_nSum, nValue);
+		if (nValue > m_nMax.load(std::memory_order_relaxed))
+		{
+			m_nMax.store(nValue, std::memory_order_relaxed);
+		}
+	}
+
+	HistogramSnapshot Snapshot() const noexcept
+	{
+		HistogramSnapshot snapshot;
+		for (std::size_t i = 0; i < HistogramSnapshot::kBucketCount; ++i)
+		{
+			snapshot.m_arrBuckets[i] = m_arrBuckets[i].load(std::memory_order_relaxed);
+			// 总数按桶累加，和桶的内容保持一致
+			snapshot.m_nCount += snapshot.m_arrBuckets[i];
+		}
+		snapshot.m_nSum = m_nSum.load(std::memory_order_relaxed);
+		snapshot.m_nMax = m_nMax.load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+private:
+	static void Add(std::atomic<std::uint64_t>& nCounter, std::uint64_t nValue) noexcept
+	{
+		nCounter.store(nCounter.load(std::memory_order_relaxed) + nValue, std::memory_order_relaxed);
+	}
+
+private:
+	std::array<std::atomic<std::uint64_t>, HistogramSnapshot::kBucketCount> m_arrBuckets{};
+	std::atomic<std::uint64_t> m_nSum{ 0 };
+	std::atomic<std::uint64_t> m_nMax{ 0 };
+};
+
+/// ---------- Thread Metrics ----------
+/// 一段执行，时间都是相对于进程启动的纳秒数
+struct TraceEvent
+{
+	const char* m_szName = nullptr;
+	std::uint64_t m_nStart = 0;
+	std::uint64_t m_nDuration = 0;
+	const void* m_pTask = nullptr;
+};
+
+struct ThreadMetricsSnapshot
+{
+	std::uint32_t m_nThreadIndex = 0;
+	HistogramSnapshot m_StartDelay;
+	HistogramSnapshot m_Segment;
+	HistogramSnapshot m_Suspensions;
+	HistogramSnapshot m_QueueDepth;
+	std::uint64_t m_nResumes = 0;
+	std::uint64_t m_nTraceEvents = 0;
+	std::uint64_t m_nDroppedEvents = 0;
+
+	void Merge(const ThreadMetricsSnapshot& snapshot)
+	{
+		m_StartDelay.Merge(snapshot.m_StartDelay);
+		m_Segment.Merge(snapshot.m_Segment);
+		m_Suspensions.Merge(snapshot.m_Suspensions);
+		m_QueueDepth.Merge(snapshot.m_QueueDepth);
+		m_nResumes += snapshot.m_nResumes;
+		m_nTraceEvents += snapshot.m_nTraceEvents;
+		m_nDroppedEvents += snapshot.m_nDroppedEvents;
+	}
+};
+
+struct MetricsSnapshot
+{
+	std::vector<ThreadMetricsSnapshot> m_vecThreads;
+
+	ThreadMetricsSnapshot Total() const
+	{
+		ThreadMetricsSnapshot total;
+		for (auto& thread : m_vecThreads)
+		{
+			total.Merge(thread);
+		}
+		return total;
+	}
+};
+
+/// 线程退出后数据仍然保留，直到进程结束
+/// trace 事件写进固定大小的缓冲区，写满之后丢弃，不会覆盖已经发布的事件，读的一方因此不需要同步
+class ThreadMetrics
+{
+public:
+	static constexpr std::size_t kTraceCapacity = 1 << 16;
+
+	explicit ThreadMetrics(std::uint32_t nIndex) noexcept
+		: m_nIndex(nIndex) {};
+
+	void AddResume() noexcept
+	{
+		m_nResumes.store(m_nResumes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void AddTraceEvent(const TraceEvent& event)
+	{
+		auto nCount = m_nEventCount.load(std::memory_order_relaxed);
+		if (nCount == kTraceCapacity)
+		{
+			m_nDropped.store(m_nDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		if (!m_pEvents)
+		{
+			m_pEvents = std::make_unique<TraceEvent[]>(kTraceCapacity);
+		}
+		m_pEvents[nCount] = event;
+		// 事件（以及第一次分配的缓冲区）先写好，再发布数量
+		m_nEventCount.store(nCount + 1, std::memory_order_release);
+	}
+
+	ThreadMetricsSnapshot Snapshot() const
+	{
+		ThreadMetricsSnapshot snapshot;
+		snapshot.m_nThreadIndex = m_nIndex;
+		snapshot.m_StartDelay = m_StartDelay.Snapshot();
+		snapshot.m_Segment = m_Segment.Snapshot();
+		snapshot.m_Suspensions = m_Suspensions.Snapshot();
+		snapshot.m_QueueDepth = m_QueueDepth.Snapshot();
+		snapshot.m_nResumes = m_nResumes.load(std::memory_order_relaxed);
+		snapshot.m_nTraceEvents = m_nEventCount.load(std::memory_order_relaxed);
+		snapshot.m_nDroppedEvents = m_nDropped.load(std::memory_order_relaxed);
+		return snapshot;
+	}
+
+	// 已经发布的事件，之后不会再被修改
+	std::pair<const TraceEvent*, std::size_t> TraceEvents() const
+	{
+		auto nCount = m_nEventCount.load(std::memory_order_acquire);
+		return { nCount == 0 ? nullptr : m_pEvents.get(), nCount };
+	}
+
+	std::uint32_t Index() const
+	{
+		return m_nIndex;
+	}
+
+	Histogram m_StartDelay;
+	Histogram m_Segment;
+	Histogram m_Suspensions;
+	Histogram m_QueueDepth;
+
+private:
+	std::uint32_t m_nIndex;
+	std::atomic<std::uint64_t> m_nResumes{ 0 };
+
+	std::unique_ptr<TraceEvent[]> m_pEvents;
+	std::atomic<std::size_t> m_nEventCount{ 0 };
+	std::atomic<std::uint64_t> m_nDropped{ 0 };
+};
+
+/// ---------- Coroutine Metrics ----------
+class CoroutineMetrics
+{
+public:
+	// 当前线程的统计，第一次调用时登记，只有这里需要加锁
+	static ThreadMetrics& Local()
+	{
+		thread_local ThreadMetrics* pLocal = Register();
+		return *pLocal;
+	}
+
+	static std::uint64_t Now() noexcept
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - s_tpOrigin).count());
+	}
+
+	// 工作线程取任务时调用，关闭统计时什么也不做
+	static void RecordQueueDepth(std::size_t nDepth) noexcept
+	{
+		if constexpr (kCoroutineInstrumentation)
+		{
+			Local().m_QueueDepth.Record(nDepth);
+		}
+	}
+
+	static void EnableTrace(bool bEnabled) noexcept
+	{
+		s_bTraceEnabled.store(bEnabled, std::memory_order_relaxed);
+	}
+
+	static bool IsTraceEnabled() noexcept
+	{
+		return s_bTraceEnabled.load(std::memory_order_relaxed);
+	}
+
+	static MetricsSnapshot Snapshot()
+	{
+		MetricsSnapshot snapshot;
+		std::lock_guard lock(s_lMutex);
+		snapshot.m_vecThreads.reserve(s_vecThreads.size());
+		for (auto& pThread : s_vecThreads)
+		{
+			snapshot.m_vecThreads.push_back(pThread->Snapshot());
+		}
+		return snapshot;
+	}
+
+	/// Chrome trace event 格式，每一段执行是一个 "X"（complete）事件，时间单位是微秒
+	static void WriteChromeTrace(std::ostream& stream)
+	{
+		std::lock_guard lock(s_lMutex);
+		stream << "{\"traceEvents\":[";
+		bool bFirst = true;
+		for (auto& pThread : s_vecThreads)
+		{
+			auto [pEvents, nCount] = pThread->TraceEvents();
+			if (nCount == 0)
+			{
+				continue;
+			}
+			stream << (bFirst ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pThread->Index()
+				<< ",\"args\":{\"name\":\"thread " << pThread->Index() << "\"}}";
+			bFirst = false;
+			for (std::size_t i = 0; i < nCount; ++i)
+			{
+				auto& event = pEvents[i];
+				stream << ",\n{\"name\":";
+				WriteJsonString(stream, event.m_szName);
+				stream << ",\"cat\":\"task\",\"ph\":\"X\",\"ts\":";
+				WriteMicroseconds(stream, event.m_nStart);
+				stream << ",\"dur\":";
+				WriteMicroseconds(stream, event.m_nDuration);
+				stream << ",\"pid\":1,\"tid\":" << pThread->Index()
+					<< ",\"args\":{\"task\":\"" << event.m_pTask << "\"}}";
+			}
+		}
+		stream << "\n]}\n";
+	}
+
+private:
+	static ThreadMetrics* Register()
+	{
+		std::lock_guard lock(s_lMutex);
+		auto nIndex = static_cast<std::uint32_t>(s_vecThreads.size());
+		return s_vecThreads.emplace_back(std::make_unique<ThreadMetrics>(nIndex)).get();
+	}
+
+	static void WriteMicroseconds(std::ostream& stream, std::uint64_t nNanoseconds)
+	{
+		auto nFraction = nNanoseconds % 1000;
+		stream << nNanoseconds / 1000 << '.' << static_cast<char>('0' + nFraction / 100)
+			<< static_cast<char>('0' + nFraction / 10 % 10) << static_cast<char>('0' + nFraction % 10);
+	}
+
+	static void WriteJsonString(std::ostream& stream, const char* szValue)
+	{
+		static constexpr char kHex[] = "0123456789abcdef";
+		stream << '"';
+		for (auto p = szValue != nullptr ? szValue : ""; *p != '\0'; ++p)
+		{
+			auto c = static_cast<unsigned char>(*p);
+			if (c == '"' || c == '\\')
+			{
+				stream << '\\' << *p;
+			}
+			else if (c < 0x20)
+			{
+				stream << "\\u00" << kHex[c >> 4] << kHex[c & 0xf];
+			}
+			else
+			{
+				stream << *p;
+			}
+		}
+		stream << '"';
+	}
+
+private:
+	static inline const std::chrono::steady_clock::time_point s_tpOrigin = std::chrono::steady_clock::now();
+	static inline std::atomic<bool> s_bTraceEnabled{ false };
+
+	static inline std::mutex s_lMutex;
+	static inline std::vector<std::unique_ptr<ThreadMetrics>> s_vecThreads;
+};
+
+/// ---------- Task Trace ----------
+/// 放在 TaskPromise 里，均由正在执行这个 Task 的线程调用，所以成员本身不需要同步
+/// Wrap 把 co_await 的 Awaiter 包一层：挂起之前结束当前这一段，恢复之后开始新的一段
+/// Awaiter 拒绝挂起（await_suspend 返回 false 或者自己的句柄）时也会算作一次挂起
+/// await_ready 返回 true 时 await_suspend 不会被调用，这一段没有结束，恢复也不记录
+/// initial_suspend 例外：不管有没有挂起，第一段都从 await_resume 开始
+#if CPPFEATURE_CORO_INSTRUMENTATION
+
+class TaskTrace;
+
+template <typename TAwaiter, bool bInitial = false>
+class TracedAwaiter
+{
+public:
+	TracedAwaiter(TaskTrace* pTrace, TAwaiter&& awaiter)
+		: m_pTrace(pTrace), m_Awaiter(std::forward<TAwaiter>(awaiter)) {};
+
+	bool await_ready()
+	{
+		return m_Awaiter.await_ready();
+	}
+
+	template <typename TPromise>
+	auto await_suspend(std::coroutine_handle<TPromise> handle);
+
+	decltype(auto) await_resume();
+
+private:
+	TaskTrace* m_pTrace;
+	// 左值 Awaiter 保存引用，右值 Awaiter 移动进来
+	TAwaiter m_Awaiter;
+	// await_suspend 执行过，await_resume 才需要开始新的一段
+	bool m_bSuspended = false;
+};
+
+class TaskTrace
+{
+public:
+	void OnCreate(const std::source_location& location) noexcept
+	{
+		m_szName = location.function_name();
+		m_nCreated = CoroutineMetrics::Now();
+	}
+
+	void OnResume()
+	{
+		auto nNow = CoroutineMetrics::Now();
+		auto& metrics = CoroutineMetrics::Local();
+		if (!m_bStarted)
+		{
+			m_bStarted = true;
+			metrics.m_StartDelay.Record(nNow - m_nCreated);
+		}
+		metrics.AddResume();
+		m_nSegmentStart = nNow;
+	}
+
+	void OnSuspend()
+	{
+		EndSegment();
+		++m_nSuspensions;
+	}
+
+	void OnComplete()
+	{
+		EndSegment();
+		CoroutineMetrics::Local().m_Suspensions.Record(m_nSuspensions);
+	}
+
+	template <typename TAwaiter>
+	TracedAwaiter<TAwaiter> Wrap(TAwaiter&& awaiter)
+	{
+		return { this, std::forward<TAwaiter>(awaiter) };
+	}
+
+	// initial_suspend 的 Awaiter，只在恢复时开始第一段
+	template <typename TAwaiter>
+	TracedAwaiter<TAwaiter, true> WrapInitial(TAwaiter&& awaiter)
+	{
+		return { this, std::forward<TAwaiter>(awaiter) };
+	}
+
+private:
+	void EndSegment()
+	{
+		auto nNow = CoroutineMetrics::Now();
+		auto& metrics = CoroutineMetrics::Local();
+		metrics.m_Segment.Record(nNow - m_nSegmentStart);
+		if (CoroutineMetrics::IsTraceEnabled())
+		{
+			metrics.AddTraceEvent(TraceEvent{ m_szName, m_nSegmentStart, nNow - m_nSegmentStart, this });
+		}
+	}
+
+private:
+	const char* m_szName = nullptr;
+	std::uint64_t m_nCreated = 0;
+	std::uint64_t m_nSegmentStart = 0;
+	std::uint64_t m_nSuspensions = 0;
+	bool m_bStarted = false;
+};
+
+template <typename TAwaiter, bool bInitial>
+template <typename TPromise>
+auto TracedAwaiter<TAwaiter, bInitial>::await_suspend(std::coroutine_handle<TPromise> handle)
+{
+	// 交给内层 Awaiter 之后协程随时可能在别的线程上恢复，所以先结束这一段
+	if constexpr (!bInitial)
+	{
+		m_pTrace->OnSuspend();
+	}
+	m_bSuspended = true;
+	return m_Awaiter.await_suspend(handle);
+}
+
+template <typename TAwaiter, bool bInitial>
+decltype(auto) TracedAwaiter<TAwaiter, bInitial>::await_resume()
+{
+	if (bInitial || m_bSuspended)
+	{
+		m_pTrace->OnResume();
+	}
+	return m_Awaiter.await_resume();
+}
+
+#else
+
+class TaskTrace
+{
+public:
+	void OnCreate(const std::source_location&) noexcept {}
+	void OnComplete() noexcept {}
+
+	template <typename TAwaiter>
+	static TAwaiter&& Wrap(TAwaiter&& awaiter) noexcept
+	{
+		return std::forward<TAwaiter>(awaiter);
+	}
+
+	template <typename TAwaiter>
+	static TAwaiter&& WrapInitial(TAwaiter&& awaiter) noexcept
+	{
+		return std::forward<TAwaiter>(awaiter);
+	}
+};
+
+#endif
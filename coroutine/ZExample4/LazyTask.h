@@ -0,0 +1,101 @@
+#pragma once
+
+#include <coroutine>
+#include <source_location>
+#include <stop_token>
+#include <utility>
+
+#include "Executor.h"
+#include "Task.h"
+
+/// 延迟启动的 Task
+/// Task 创建后立刻交给调度器，调用方还没来得及决定它运行在哪里，它就已经开始执行了
+/// LazyTask 创建后什么都不做，直到：
+///		1. 在另一个协程里被 co_await：继承等待方的调度器，对称转移过去直接开始执行，不经过调度器的队列
+///		2. 调用 ScheduleOn(executor)：交给指定的调度器开始执行，返回普通的 Task
+/// 还没有开始执行，所以也可以安全地继承等待方的取消 token，或者在 ScheduleOn 时指定
+/// 这样可以先把整张依赖图搭好，再把入口一次性交给合适的调度器
+///
+///		LazyTask<int> Leaf(int i) { co_return i; }
+///		LazyTask<int> Root() { co_return co_await Leaf(1) + co_await Leaf(2); }
+///		auto task = Root().ScheduleOn(WorkStealingExecutor::Shared());
+
+template <typename T>
+class LazyTask;
+
+template <typename T>
+class LazyTaskPromise : public TaskPromise<T>
+{
+public:
+	using TaskPromise<T>::TaskPromise;
+
+	// 挂起在这里，等待被 co_await 或者 ScheduleOn
+	auto initial_suspend() noexcept { return this->m_Trace.WrapInitial(std::suspend_always{}); }
+
+	LazyTask<T> get_return_object(const std::source_location& location = std::source_location::current())
+	{
+		this->m_Trace.OnCreate(location);
+		return LazyTask<T>{ std::coroutine_handle<LazyTaskPromise>::from_promise(*this) };
+	}
+};
+
+template <typename T>
+class LazyTask
+{
+public:
+	using promise_type = LazyTaskPromise<T>;
+
+	// 交给指定的调度器开始执行，之后就和普通的 Task 一样
+	// 协程参数中没有 token 时使用 token
+	Task<T> ScheduleOn(AbstractExecutor& executor, const std::stop_token& token = {}) &&
+	{
+		auto handle = m_coroHandle;
+		auto task = std::move(*this).Bind(&executor, token);
+		executor.Schedule(handle);
+		return task;
+	}
+
+	// 在协程自己的调度器上开始执行（默认是全局线程池，或者第一个参数指定的调度器）
+	Task<T> Start() &&
+	{
+		auto& executor = *m_coroHandle.promise().GetExecutor();
+		return std::move(*this).ScheduleOn(executor);
+	}
+
+	explicit LazyTask(std::coroutine_handle<promise_type> handle) noexcept
+		: m_coroHandle(handle) {};
+
+	LazyTask(LazyTask&& task) noexcept
+		: m_coroHandle(std::exchange(task.m_coroHandle, {})) {};
+
+	LazyTask(LazyTask&) = delete;
+	LazyTask& operator=(LazyTask&) = delete;
+
+	~LazyTask()
+	{
+		// 从来没有开始过的协程直接销毁
+		if (m_coroHandle)
+		{
+			m_coroHandle.destroy();
+		}
+	}
+
+private:
+	friend class TaskAwaiter<T>;
+
+	// 确定调度器和取消 token，把协程交给 Task 管理，但还不开始执行
+	// 协程参数中指定的 token 优先
+	Task<T> Bind(AbstractExecutor* pExecutor, const std::stop_token& token) &&
+	{
+		auto& promise = m_coroHandle.promise();
+		promise.SetExecutor(pExecutor);
+		if (!promise.GetStopToken().stop_possible())
+		{
+			promise.SetStopToken(token);
+		}
+		return Task<T>{ std::exchange(m_coroHandle, {}) };
+	}
+
+private:
+	std::coroutine_handle<promise_type> m_coroHandle{};
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <exception>
+#include <utility>
+#include <variant>
+
+/// ---------- Result ----------
+/// 结果类型，用来承载 Task 正常返回和异常抛出两种情况
+/// 值和异常只会有一个，用 std::variant 存放，T 不需要默认构造，也可以是只能移动的类型
+template <typename T>
+class Result
+{
+public:
+	// 当 Task 正常返回的时候，把返回值移动进来
+	explicit Result(T&& value) : m_varStorage(std::in_place_index<0>, std::move(value)) {};
+	// 当 Task 抛异常的时候，存放异常
+	explicit Result(std::exception_ptr&& e) : m_varStorage(std::in_place_index<1>, std::move(e)) {};
+
+	bool HasValue() const
+	{
+		return m_varStorage.index() == 0;
+	}
+
+	// 获取结果，有异常则抛异常，没有则返回结果的引用，不复制
+	T& GetOrThrow() &
+	{
+		RethrowIfException();
+		return std::get<0>(m_varStorage);
+	}
+
+	const T& GetOrThrow() const&
+	{
+		RethrowIfException();
+		return std::get<0>(m_varStorage);
+	}
+
+	// 把结果移出来，之后 Result 里只剩下被移动过的值，只能调用一次
+	T GetOrThrow() &&
+	{
+		RethrowIfException();
+		return std::move(std::get<0>(m_varStorage));
+	}
+
+private:
+	void RethrowIfException() const
+	{
+		if (m_varStorage.index() == 1)
+		{
+			std::rethrow_exception(std::get<1>(m_varStorage));
+		}
+	}
+
+private:
+	std::variant<T, std::exception_ptr> m_varStorage;	// 结果值或者抛出的异常
+};
+
+/// 没有返回值的 Task 只需要记录异常
+template <>
+class Result<void>
+{
+public:
+	// 正常结束
+	explicit Result() = default;
+	// 抛出异常
+	explicit Result(std::exception_ptr&& e) : m_pException(std::move(e)) {};
+
+	bool HasValue() const
+	{
+		return !m_pException;
+	}
+
+	void GetOrThrow() const
+	{
+		if (m_pException)
+		{
+			std::rethrow_exception(m_pException);
+		}
+	}
+
+private:
+	std::exception_ptr m_pException{ nullptr };	// 抛出的异常
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/// 单生产者单消费者的环形缓冲区
+/// 生产者只写 tail，消费者只写 head，各自的位置只有自己修改，不需要 CAS
+/// 位置一直递增，取模之后才是下标，head == tail 表示空，tail - head == 容量表示满
+/// 消费者直接在槽位上读取元素（Front），用完再 Pop，槽位这时才交还给生产者
+template <typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(std::size_t nCapacity)
+		: m_nCapacity(std::max<std::size_t>(nCapacity, 1)), m_pSlots(new std::optional<T>[m_nCapacity]) {};
+
+	SpscRing(SpscRing&) = delete;
+	SpscRing& operator=(SpscRing&) = delete;
+
+	std::size_t Capacity() const noexcept
+	{
+		return m_nCapacity;
+	}
+
+	/// 两边都可以调用，读到的是某一时刻的近似值
+	std::size_t Size() const noexcept
+	{
+		return m_nTail.load(std::memory_order_acquire) - m_nHead.load(std::memory_order_acquire);
+	}
+
+	/// ---------- Producer ----------
+	bool Full() const noexcept
+	{
+		return m_nTail.load(std::memory_order_relaxed) - m_nHead.load(std::memory_order_acquire) == m_nCapacity;
+	}
+
+	// 调用方保证没有满
+	template <typename U>
+	void Push(U&& value)
+	{
+		auto nTail = m_nTail.load(std::memory_order_relaxed);
+		m_pSlots[nTail % m_nCapacity].emplace(std::forward<U>(value));
+		m_nTail.store(nTail + 1, std::memory_order_release);
+	}
+
+	/// ---------- Consumer ----------
+	// 空的时候返回 nullptr
+	T* Front() noexcept
+	{
+		auto nHead = m_nHead.load(std::memory_order_relaxed);
+		if (nHead == m_nTail.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+		return std::addressof(*m_pSlots[nHead % m_nCapacity]);
+	}
+
+	void Pop() noexcept
+	{
+		auto nHead = m_nHead.load(std::memory_order_relaxed);
+		m_pSlots[nHead % m_nCapacity].reset();
+		m_nHead.store(nHead + 1, std::memory_order_release);
+	}
+
+private:
+	const std::size_t m_nCapacity;
+	std::unique_ptr<std::optional<T>[]> m_pSlots;
+
+	// 分开放在不同的缓存行上，生产者和消费者不会互相让对方的缓存失效
+	alignas(64) std::atomic<std::size_t> m_nHead{ 0 };
+	alignas(64) std::atomic<std::size_t> m_nTail{ 0 };
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "Executor.h"
+#include "Result.h"
+#include "TaskPromise.h"
+#include "TaskAwaiter.h"
+
+/// ---------- Task ----------
+/// 协程的返回类型，协程默认运行在全局线程池上
+/// co_await 另一个 Task 时，当前协程挂起，等它完成后再回到自己的调度器上恢复
+/// Task 创建后就已经在调度器上执行了，没有完成就析构时不会销毁协程帧，协程继续执行，完成后自己销毁
+/// 登记过的 Then/Catching/Finally 回调照常执行
+template <typename T>
+class Task
+{
+public:
+	// 协程协议
+	using promise_type = TaskPromise<T>;
+
+	T GetResult()
+	{
+		return m_pPromise->GetResult();
+	}
+
+	// 登记 Task 完成后要做的事情，返回 false 表示已经完成了
+	bool AddContinuation(TaskContinuation<T>* pContinuation)
+	{
+		return m_pPromise->AddContinuation(pContinuation);
+	}
+
+	// 执行回调，回调拿到的是结果的引用，Task<void> 的回调没有参数，Task 抛出异常时不执行
+	// 回调直接存放在登记的节点里，不经过 std::function
+	// Then/Catching/Finally 的回调都不能抛出异常：回调可能在协程完成时的 noexcept 路径上执行
+	// 所以三者一律按 noexcept 调用，回调抛出异常会调用 std::terminate，而不是被悄悄吞掉
+	template <typename F>
+	Task& Then(F&& func)
+	{
+		m_pPromise->OnCompleted([func = std::forward<F>(func)](auto& result) mutable noexcept {
+			if (!result.HasValue())
+			{
+				return;
+			}
+			if constexpr (std::is_void_v<T>)
+			{
+				func();
+			}
+			else
+			{
+				func(std::as_const(result.GetOrThrow()));
+			}
+			});
+		return *this;
+	}
+	// 执行异常，只有 std::exception 的派生类才会传给回调，其余的异常只能通过 GetResult 拿到
+	template <typename F>
+	Task& Catching(F&& func)
+	{
+		m_pPromise->OnCompleted([func = std::forward<F>(func)](auto& result) mutable noexcept {
+			if (result.HasValue())
+			{
+				return;
+			}
+			try
+			{
+				result.GetOrThrow();
+			}
+			catch (std::exception& e)
+			{
+				func(e);
+			}
+			catch (...)
+			{
+			}
+			});
+		return *this;
+	}
+
+	template <typename F>
+	Task& Finally(F&& func)
+	{
+		m_pPromise->OnCompleted([func = std::forward<F>(func)](auto&) mutable noexcept {
+			func();
+			});
+		return *this;
+	}
+
+	// promise 可以是 TaskPromise 的派生类，例如 LazyTaskPromise
+	template <typename TPromise>
+	explicit Task(std::coroutine_handle<TPromise> handle) noexcept
+		: m_coroHandle(handle), m_pPromise(&handle.promise()) {};
+
+	Task(Task&& task) noexcept
+		: m_coroHandle(std::exchange(task.m_coroHandle, {})), m_pPromise(std::exchange(task.m_pPromise, nullptr)) {};
+
+	Task(Task&) = delete;
+	Task& operator=(Task&) = delete;
+
+	~Task()
+	{
+		if (m_coroHandle)
+		{
+			m_pPromise->Release(m_coroHandle);
+		}
+	}
+
+private:
+	// 协程句柄
+	std::coroutine_handle<> m_coroHandle{};
+	TaskPromise<T>* m_pPromise = nullptr;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <coroutine>
+#include <stop_token>
+#include <utility>
+
+#include "Executor.h"
+#include "TaskPromise.h"
+
+template <typename T>
+class Task;
+
+template <typename T>
+class LazyTask;
+
+/// ---------- Awaitable ----------
+template <typename T>
+class TaskAwaiter
+{
+public:
+	// pExecutor 是等待方协程的调度器，Task 完成后等待方要回到自己的调度器上恢复
+	explicit TaskAwaiter(AbstractExecutor* pExecutor, Task<T>&& task) noexcept
+		: m_pExecutor(pExecutor), m_Task(std::move(task)) {};
+
+	// 还没有开始的 LazyTask 运行在等待方的调度器上，自己没有 token 时使用等待方的 token
+	explicit TaskAwaiter(AbstractExecutor* pExecutor, const std::stop_token& token, LazyTask<T>&& task) noexcept
+		: m_pExecutor(pExecutor), m_hStart(task.m_coroHandle), m_Task(std::move(task).Bind(pExecutor, token)) {};
+
+	TaskAwaiter(TaskAwaiter&& completion) noexcept
+		: m_pExecutor(completion.m_pExecutor), m_hStart(completion.m_hStart), m_Task(std::move(completion.m_Task)) {};
+
+	TaskAwaiter(TaskAwaiter&) = delete;
+	TaskAwaiter& operator=(TaskAwaiter) = delete;
+
+	/// awaitable协议相关接口
+	constexpr bool await_ready() const noexcept
+	{
+		/// co_await后立马挂起，然后走 await_suspend 的逻辑
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept
+	{
+		// task执行完后，由 task 的 final_suspend 直接转移回当前协程
+		// 如果 task 已经完成了，就不用挂起，直接恢复当前协程
+		// task 还没有开始时，直接转移过去，在当前线程上开始执行
+		m_Continuation.m_hContinuation = handle;
+		m_Continuation.m_pExecutor = m_pExecutor;
+		// 登记之后 task 随时可能在别的线程上完成并恢复当前协程，当前协程跑完后 awaiter 所在的帧就销毁了
+		// 所以需要的成员提前取出来，登记之后不再访问 this
+		auto hStart = m_hStart;
+		if (m_Task.AddContinuation(&m_Continuation))
+		{
+			return hStart ? hStart : std::noop_coroutine();
+		}
+		return handle;
+	}
+
+	T await_resume()
+	{
+		// 协程 resume 后执行到这里，返回task执行完后的值
+		// task 抛出的异常也会在这里继续抛给等待方
+		return m_Task.GetResult();
+	}
+
+private:
+	AbstractExecutor* m_pExecutor;
+	std::coroutine_handle<> m_hStart{};
+	Task<T> m_Task;
+	// 登记到 Task 上的节点，跟着等待方的协程帧一起分配
+	TaskContinuation<T> m_Continuation{};
+};
@@ -0,0 +1,457 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <source_location>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+#include "Cancellation.h"
+#include "Executor.h"
+#include "FrameAllocator.h"
+#include "Instrumentation.h"
+#include "Result.h"
+
+template <typename T>
+class Task;
+
+template <typename T>
+class LazyTask;
+
+template <typename T>
+class TaskAwaiter;
+
+/// ---------- Continuation ----------
+/// Task 完成后要做的事情，用单链表串起来，节点由登记方提供
+///		1. co_await 的协程：节点就放在 TaskAwaiter 里，也就是等待方自己的协程帧中，不需要额外分配
+///		2. 通知函数：节点放在 WhenAll/WhenAny 的等待体里，返回需要恢复的协程
+///		3. Then/Catching/Finally 回调：第一个回调放在 promise 里预留的槽位中，后面的从 FramePool 中分配
+///		   回调对象和节点放在同一块内存里，不经过 std::function，登记和执行都不需要分配
+/// 1 和 2 在发布完成状态之后执行，3 在发布之前执行
+template <typename T>
+struct TaskContinuation
+{
+	TaskContinuation* m_pNext = nullptr;
+
+	// 等待方协程以及它所属的调度器
+	std::coroutine_handle<> m_hContinuation{};
+	AbstractExecutor* m_pExecutor = nullptr;
+
+	// 通知函数以及它的参数，返回要恢复的协程，它同样属于 m_pExecutor
+	// 返回 noop_coroutine 表示不需要恢复任何协程
+	std::coroutine_handle<> (*m_pfnNotify)(void* pContext) = nullptr;
+	void* m_pContext = nullptr;
+
+	// 回调，pResult 不为空时先执行回调，然后销毁回调对象、释放节点
+	// pResult 为空表示 Task 没有完成就被销毁了，只销毁和释放
+	void (*m_pfnCallback)(TaskContinuation* pContinuation, Result<T>* pResult) = nullptr;
+};
+
+/// ---------- Promise Type ----------
+/// 完成状态只用一个原子变量 m_pState 表示：
+///		nullptr		-> 还没有完成，也没有人登记
+///		this		-> 已经完成
+///		其他			-> 还没有完成，指向登记的 TaskContinuation 链表头
+/// 登记和完成都通过 CAS 完成交接，不需要加锁
+/// 协程帧由 Task 和协程自己共同持有（m_nRefs），Task 析构和 Complete 各释放一次，最后释放的一方销毁协程帧
+/// 所以 Task 可以在协程完成之前析构，这时协程继续执行，完成后由 Complete 销毁
+/// 协程帧从 FramePool 中分配，也支持 std::allocator_arg 指定 memory_resource
+/// return_value 和 return_void 不能同时出现，所以公共部分放在 TaskPromiseBase 里
+/// 由 TaskPromise<T> 和 TaskPromise<void> 分别提供
+/// 所有挂起和恢复的位置都经过 m_Trace，打开 CPPFEATURE_CORO_INSTRUMENTATION 后在这里统计（见 Instrumentation.h）
+template <typename T>
+class TaskPromise;
+
+template <typename T>
+class TaskPromiseBase : public PooledPromise
+{
+	using Continuation = TaskContinuation<T>;
+
+	// 大多数 Task 最多只有一个回调，放在 promise 里，放得下 std::function 或者捕获四个指针的 lambda
+	static constexpr std::size_t kInlineCallbackSize = 4 * sizeof(void*);
+
+	struct InlineCallback : Continuation
+	{
+		std::atomic<bool> m_bClaimed{ false };
+		alignas(std::max_align_t) std::byte m_Storage[kInlineCallbackSize];
+	};
+
+	// 放不进槽位的回调和节点一起从 FramePool 中分配，释放后留在线程的空闲链表里复用
+	template <typename F>
+	struct CallbackNode : Continuation
+	{
+		F m_Func;
+
+		template <typename U>
+		explicit CallbackNode(U&& func) : m_Func(std::forward<U>(func))
+		{
+			this->m_pfnCallback = &Invoke;
+		}
+
+		static void Invoke(Continuation* pContinuation, Result<T>* pResult)
+		{
+			auto pNode = static_cast<CallbackNode*>(pContinuation);
+			if (pResult != nullptr)
+			{
+				pNode->m_Func(*pResult);
+			}
+			pNode->~CallbackNode();
+			FramePool::Deallocate(pNode);
+		}
+	};
+
+	template <typename F>
+	static void InvokeInline(Continuation* pContinuation, Result<T>* pResult)
+	{
+		auto& func = *std::launder(reinterpret_cast<F*>(static_cast<InlineCallback*>(pContinuation)->m_Storage));
+		if (pResult != nullptr)
+		{
+			func(*pResult);
+		}
+		func.~F();
+	}
+
+public:
+	// 默认调度到全局共享的线程池上
+	TaskPromiseBase() = default;
+
+	// 没有完成就被销毁时（例如挂起中的协程被 destroy），登记的回调不会再执行，只释放它们
+	~TaskPromiseBase()
+	{
+		auto pState = m_pState.load(std::memory_order_acquire);
+		if (pState == CompletedState())
+		{
+			return;
+		}
+		for (auto p = static_cast<Continuation*>(pState); p != nullptr;)
+		{
+			auto pContinuation = std::exchange(p, p->m_pNext);
+			if (pContinuation->m_pfnCallback != nullptr)
+			{
+				pContinuation->m_pfnCallback(pContinuation, nullptr);
+			}
+		}
+	}
+
+	// 协程的第一个参数是调度器时，协程就运行在这个调度器上
+	// 参数中有 std::stop_token 时，它就是这个协程的取消 token
+	// Task<int> Foo(AbstractExecutor& executor, std::stop_token token, ...)
+	template <typename TFirst, typename ...TArgs>
+	explicit TaskPromiseBase(TFirst& first, TArgs&... args)
+		: m_tokStop(FindStopToken(first, args...))
+	{
+		if constexpr (std::is_base_of_v<AbstractExecutor, TFirst> && !std::is_const_v<TFirst>)
+		{
+			m_pExecutor = &first;
+		}
+	}
+
+	// 协议接口
+	// 协程启动时先挂起，交给调度器后再开始执行
+	auto initial_suspend() { return m_Trace.WrapInitial(DispatchAwaiter{ m_pExecutor }); }
+
+	// 协程执行完后挂起，这时协程已经完全停下来了，才可以通知外部结果已经准备好
+	// 否则外部拿到结果后销毁 Task 时，协程可能还在执行 return_value 之后的代码
+	// await_suspend 返回等待方的句柄，控制权直接转移给等待方（对称转移）
+	// 不会在当前调用栈上再嵌套一层 resume
+	// TaskPromise 和 LazyTaskPromise 都是派生类，所以句柄的类型是模板参数
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		template <typename TPromise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+		{
+			auto& promise = static_cast<TaskPromiseBase&>(handle.promise());
+			promise.m_Trace.OnComplete();
+			return promise.Complete(handle);
+		}
+		void await_resume() const noexcept {}
+	};
+	FinalAwaiter final_suspend() noexcept { return {}; }
+
+	// 默认参数在协程的调用处求值，location 就是协程函数本身
+	Task<T> get_return_object(const std::source_location& location = std::source_location::current())
+	{
+		m_Trace.OnCreate(location);
+		auto& promise = static_cast<TaskPromise<T>&>(*this);
+		return Task<T>{ std::coroutine_handle<TaskPromise<T>>::from_promise(promise) };
+	}
+	void unhandled_exception()
+	{
+		// 存储异常，m_pState 发布完成状态时一并对其他线程可见
+		m_tResult.emplace(std::current_exception());
+	}
+
+	/// co_await 支持相关接口
+	template <typename R>
+	auto await_transform(Task<R>&& task)
+	{
+		// 返回一个TaskAwaiter对象，子 Task 完成后回到当前协程的调度器上恢复
+		return m_Trace.Wrap(TaskAwaiter<R>(m_pExecutor, std::move(task)));
+	}
+
+	// 还没有开始的 LazyTask 继承当前协程的调度器和取消 token，登记完后直接转移过去执行
+	template <typename R>
+	auto await_transform(LazyTask<R>&& task)
+	{
+		return m_Trace.Wrap(TaskAwaiter<R>(m_pExecutor, m_tokStop, std::move(task)));
+	}
+
+	// 其他的 Awaiter 原样返回，例如 AsyncGenerator::next()
+	template <typename TAwaiter>
+	decltype(auto) await_transform(TAwaiter&& awaiter)
+	{
+		return m_Trace.Wrap(std::forward<TAwaiter>(awaiter));
+	}
+
+	// 结果从 Result 中移出来，只能取一次
+	T GetResult()
+	{
+		// 协程还没有运行完，等待 Complete 中的 notify_all 后再返回
+		// 返回之后 Task 可以马上析构，Complete 自己持有协程帧直到 notify_all 结束
+		auto pState = m_pState.load(std::memory_order_acquire);
+		while (pState != CompletedState())
+		{
+			m_pState.wait(pState, std::memory_order_acquire);
+			pState = m_pState.load(std::memory_order_acquire);
+		}
+		// 如果有值，直接返回 (或抛异常)
+		return std::move(*m_tResult).GetOrThrow();
+	}
+
+	AbstractExecutor* GetExecutor() const
+	{
+		return m_pExecutor;
+	}
+
+	// 只能在协程开始执行之前修改，用于 LazyTask
+	void SetExecutor(AbstractExecutor* pExecutor)
+	{
+		m_pExecutor = pExecutor;
+	}
+
+	const std::stop_token& GetStopToken() const
+	{
+		return m_tokStop;
+	}
+
+	// 和 SetExecutor 一样只能在协程开始执行之前修改
+	void SetStopToken(std::stop_token token)
+	{
+		m_tokStop = std::move(token);
+	}
+
+	bool IsCompleted() const
+	{
+		return m_pState.load(std::memory_order_acquire) == CompletedState();
+	}
+
+	// 释放一次对协程帧的持有，由 Task 析构时调用，最后释放的一方销毁协程帧
+	// 协程还没有完成时只是放手，协程帧由 Complete 销毁
+	void Release(std::coroutine_handle<> handle) noexcept
+	{
+		if (m_nRefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			handle.destroy();
+		}
+	}
+
+	// 登记一个 Task 完成后要做的事情
+	// 返回 false 表示 Task 已经完成了，节点没有被登记
+	bool AddContinuation(Continuation* pContinuation)
+	{
+		auto pState = m_pState.load(std::memory_order_acquire);
+		do
+		{
+			if (pState == CompletedState())
+			{
+				return false;
+			}
+			pContinuation->m_pNext = static_cast<Continuation*>(pState);
+		} while (!m_pState.compare_exchange_weak(pState, pContinuation,
+			std::memory_order_release, std::memory_order_acquire));
+		return true;
+	}
+
+	// 登记一个回调，func 的参数是 Result<T>&
+	template <typename F>
+	void OnCompleted(F&& func)
+	{
+		using TFunc = std::decay_t<F>;
+		// 结果有值，则立即执行func，不需要节点
+		if (IsCompleted())
+		{
+			func(*m_tResult);
+			return;
+		}
+
+		Continuation* pContinuation = nullptr;
+		if constexpr (sizeof(TFunc) <= kInlineCallbackSize && alignof(TFunc) <= alignof(std::max_align_t))
+		{
+			// 槽位只能用一次，Task 只会完成一次，所以用过之后不需要再归还
+			if (!m_InlineCallback.m_bClaimed.exchange(true, std::memory_order_relaxed))
+			{
+				::new (static_cast<void*>(m_InlineCallback.m_Storage)) TFunc(std::forward<F>(func));
+				m_InlineCallback.m_pfnCallback = &InvokeInline<TFunc>;
+				pContinuation = &m_InlineCallback;
+			}
+		}
+		if (pContinuation == nullptr)
+		{
+			static_assert(alignof(CallbackNode<TFunc>) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+			pContinuation = ::new (FramePool::Allocate(sizeof(CallbackNode<TFunc>))) CallbackNode<TFunc>(std::forward<F>(func));
+		}
+		if (!AddContinuation(pContinuation))
+		{
+			// 登记的时候刚好完成了
+			pContinuation->m_pfnCallback(pContinuation, &*m_tResult);
+		}
+	}
+
+private:
+	void* CompletedState() const
+	{
+		return const_cast<TaskPromiseBase*>(this);
+	}
+
+	// 回调通知，由 FinalAwaiter 在协程挂起后调用
+	// 返回接下来要恢复的协程
+	std::coroutine_handle<> Complete(std::coroutine_handle<> handle) noexcept
+	{
+		// 发布完成状态之后 Task 随时可能被销毁，需要的成员提前取出来
+		auto pExecutor = m_pExecutor;
+		// 等待方协程恢复后可能马上销毁 Task，所以放到最后处理
+		Continuation* pAwaiters = nullptr;
+
+		// 先取走链表执行回调，这时还没有发布完成状态，Task 不会被销毁，回调可以直接引用结果
+		// 回调执行期间可能又有新的登记进来，所以要循环直到成功把状态换成完成
+		void* pState = m_pState.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (pState == nullptr)
+			{
+				if (m_pState.compare_exchange_weak(pState, CompletedState(),
+					std::memory_order_acq_rel, std::memory_order_acquire))
+				{
+					break;
+				}
+				continue;
+			}
+			if (!m_pState.compare_exchange_weak(pState, nullptr,
+				std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				continue;
+			}
+
+			// 链表是后登记的在前面，反转一下，按登记的顺序执行回调
+			Continuation* pList = nullptr;
+			for (auto p = static_cast<Continuation*>(pState); p != nullptr;)
+			{
+				auto pNext = std::exchange(p->m_pNext, pList);
+				pList = p;
+				p = pNext;
+			}
+			while (pList != nullptr)
+			{
+				auto pContinuation = std::exchange(pList, pList->m_pNext);
+				if (pContinuation->m_hContinuation || pContinuation->m_pfnNotify)
+				{
+					pContinuation->m_pNext = pAwaiters;
+					pAwaiters = pContinuation;
+				}
+				else
+				{
+					pContinuation->m_pfnCallback(pContinuation, &*m_tResult);
+				}
+			}
+			pState = nullptr;
+		}
+
+		// 唤醒 GetResult 中的 wait
+		// GetResult 看到完成状态后可能不经过 wait 直接返回并析构 Task，但协程帧还有这里的一次持有
+		// 所以 notify_all 访问的 m_pState 一定还有效
+		m_pState.notify_all();
+		// 释放这里的持有，Task 已经析构时协程帧在这里销毁，之后只能访问局部变量
+		Release(handle);
+
+		std::coroutine_handle<> hTransfer = std::noop_coroutine();
+		bool bTransferred = false;
+		while (pAwaiters != nullptr)
+		{
+			// 节点在等待方的协程帧里，先把需要的内容取出来
+			auto pContinuation = std::exchange(pAwaiters, pAwaiters->m_pNext);
+			auto pContinuationExecutor = pContinuation->m_pExecutor;
+			auto hContinuation = pContinuation->m_hContinuation;
+			if (pContinuation->m_pfnNotify)
+			{
+				// 通知函数返回后节点可能已经被释放了
+				hContinuation = pContinuation->m_pfnNotify(pContinuation->m_pContext);
+				if (hContinuation == std::noop_coroutine())
+				{
+					continue;
+				}
+			}
+			// 等待方和自己在同一个调度器上，直接转移过去
+			if (pContinuationExecutor == pExecutor && !bTransferred)
+			{
+				hTransfer = hContinuation;
+				bTransferred = true;
+			}
+			else
+			{
+				// 否则等待方要回到它自己的调度器上恢复
+				pContinuationExecutor->Schedule(hContinuation);
+			}
+		}
+		return hTransfer;
+	}
+
+protected:
+	// optional 可以判断 m_tResult 是否有值
+	std::optional<Result<T>> m_tResult{};		// 存放结果
+	// 关闭统计时是空类型，不占空间
+	[[no_unique_address]] TaskTrace m_Trace{};
+
+private:
+	// 协程所属的调度器
+	AbstractExecutor* m_pExecutor = &ThreadPoolExecutor::Shared();
+	// 协程的取消 token，默认为空，永远不会被取消
+	std::stop_token m_tokStop{};
+
+	// 完成状态以及登记的后续操作
+	std::atomic<void*> m_pState{ nullptr };
+	// Task 和协程自己各持有一次
+	std::atomic<int> m_nRefs{ 2 };
+	// 第一个回调的槽位
+	InlineCallback m_InlineCallback{};
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase<T>
+{
+public:
+	using TaskPromiseBase<T>::TaskPromiseBase;
+
+	void return_value(T value)
+	{
+		// 存储返回值，移动进 Result，不会复制
+		this->m_tResult.emplace(std::move(value));
+	}
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase<void>
+{
+public:
+	using TaskPromiseBase<void>::TaskPromiseBase;
+
+	void return_void()
+	{
+		m_tResult.emplace();
+	}
+};
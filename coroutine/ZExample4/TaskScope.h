@@ -0,0 +1,479 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+#include "Cancellation.h"
+#include "Executor.h"
+#include "LazyTask.h"
+#include "Task.h"
+
+/// 结构化并发
+/// 对每个元素都创建一个 Task 时，Task 创建后立刻交给调度器，几万个元素就是几万个协程帧同时压在队列里
+/// 而且 Task 析构之后就没有办法知道子 Task 什么时候完成、有没有抛出异常
+///
+/// TaskScope 持有所有的子 Task，同时执行的个数不超过上限：
+///		Task<void> Process(AbstractExecutor& executor, std::stop_token token, std::vector<Item> items)
+///		{
+///			TaskScope scope(16);
+///			for (auto& item : items)
+///			{
+///				// 已经有 16 个子 Task 在执行时挂起，等其中一个完成，取消时返回 false
+///				if (!co_await scope.Spawn(Handle(item)))
+///				{
+///					break;
+///				}
+///			}
+///			// 等待所有的子 Task 完成，有子 Task 抛出异常时在这里抛出第一个
+///			co_await scope.Join();
+///		}
+/// 子 Task 是 LazyTask，由 Spawn 启动，运行在等待方的调度器上，继承等待方的取消 token
+/// Spawn 和 Join 都只能在持有 scope 的协程里 co_await，子 Task 不能再往同一个 scope 里 Spawn
+/// 和 std::thread 一样，还有子 Task 没有完成时析构 scope 会调用 std::terminate
+
+/// ---------- Async Semaphore ----------
+/// 计数为 0 时 Acquire 挂起，Release 之后把许可直接交给等待者，交给等待方自己的调度器恢复
+/// 计数大于 0 时 Acquire 只有一次 CAS，不加锁；只有挂起的协程需要登记到等待链表上
+/// 新来的 Acquire 可能抢在等待者之前拿到许可，不保证先来先得
+/// promise 提供了 GetStopToken() 时，挂起期间请求取消会提前恢复并抛出 OperationCancelled
+class AsyncSemaphore
+{
+	struct Waiter;
+
+	struct CancelCallback
+	{
+		AsyncSemaphore* m_pSemaphore;
+		Waiter* m_pWaiter;
+
+		void operator()() const noexcept
+		{
+			m_pSemaphore->Cancel(m_pWaiter);
+		}
+	};
+
+	/// 和 Channel 的等待者一样用一个计数为 2 的门闩：
+	/// 交付许可（或者取消）的一方和 await_suspend 各释放一个，最后释放的一方负责恢复协程
+	struct Waiter
+	{
+		Waiter* m_pPrev = nullptr;
+		Waiter* m_pNext = nullptr;
+		// 是否还在等待链表上，只在持有锁时访问
+		bool m_bQueued = false;
+		bool m_bCancelled = false;
+
+		std::coroutine_handle<> m_hCoroutine{};
+		AbstractExecutor* m_pExecutor = nullptr;
+		std::atomic<int> m_nGate{ 2 };
+		// 析构时从 token 上注销，回调正在别的线程上执行时会等它结束
+		std::optional<std::stop_callback<CancelCallback>> m_optCallback{};
+
+		void Release() noexcept
+		{
+			if (m_nGate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				// 恢复之后 Awaiter 随时可能被销毁，不能再访问成员
+				m_pExecutor->Schedule(m_hCoroutine);
+			}
+		}
+	};
+
+public:
+	class AcquireAwaiter
+	{
+	public:
+		explicit AcquireAwaiter(AsyncSemaphore* pSemaphore) noexcept
+			: m_pSemaphore(pSemaphore) {};
+
+		// 协程框架可能会在挂起之前移动 Awaiter，这时还没有登记任何东西
+		AcquireAwaiter(AcquireAwaiter&& awaiter) noexcept
+			: m_pSemaphore(awaiter.m_pSemaphore) {};
+
+		AcquireAwaiter& operator=(AcquireAwaiter&) = delete;
+
+		bool await_ready() noexcept
+		{
+			return m_pSemaphore->TryAcquire();
+		}
+
+		template <typename TPromise>
+		bool await_suspend(std::coroutine_handle<TPromise> handle)
+		{
+			AbstractExecutor* pExecutor = nullptr;
+			if constexpr (requires { handle.promise().GetExecutor(); })
+			{
+				pExecutor = handle.promise().GetExecutor();
+			}
+			m_Waiter.m_hCoroutine = handle;
+			m_Waiter.m_pExecutor = pExecutor != nullptr ? pExecutor : &s_InlineExecutor;
+			return m_pSemaphore->Suspend(m_Waiter, GetStopToken(handle));
+		}
+
+		void await_resume() const
+		{
+			if (m_Waiter.m_bCancelled)
+			{
+				throw OperationCancelled();
+			}
+		}
+
+		// 不想处理异常时，恢复之后用它代替 await_resume
+		bool IsCancelled() const noexcept
+		{
+			return m_Waiter.m_bCancelled;
+		}
+
+	private:
+		AsyncSemaphore* m_pSemaphore;
+		Waiter m_Waiter{};
+	};
+
+	explicit AsyncSemaphore(std::size_t nCount) noexcept
+		: m_nCount(nCount) {};
+
+	AsyncSemaphore(AsyncSemaphore&) = delete;
+	AsyncSemaphore& operator=(AsyncSemaphore&) = delete;
+
+	// co_await 之后拿到一个许可，用完后调用 Release
+	AcquireAwaiter Acquire() noexcept
+	{
+		return AcquireAwaiter(this);
+	}
+
+	bool TryAcquire() noexcept
+	{
+		auto nCount = m_nCount.load(std::memory_order_relaxed);
+		while (nCount > 0)
+		{
+			if (m_nCount.compare_exchange_weak(nCount, nCount - 1,
+				std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Release() noexcept
+	{
+		m_nCount.fetch_add(1, std::memory_order_release);
+		Notify();
+	}
+
+	std::size_t Available() const noexcept
+	{
+		return m_nCount.load(std::memory_order_relaxed);
+	}
+
+private:
+	// 返回 true 表示需要挂起
+	bool Suspend(Waiter& waiter, const std::stop_token& token)
+	{
+		bool bSuspend = false;
+		{
+			std::lock_guard lock(m_lMutex);
+			// 和 Channel 一样，先登记再重试，和 Release 之后检查等待者的一方构成 Dekker 式的同步
+			m_nWaiters.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (token.stop_requested())
+			{
+				waiter.m_bCancelled = true;
+			}
+			else if (!TryAcquire())
+			{
+				PushBack(&waiter);
+				bSuspend = true;
+			}
+			if (!bSuspend)
+			{
+				m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (!bSuspend)
+		{
+			return false;
+		}
+		if (token.stop_possible())
+		{
+			// 已经请求过取消时回调会在这里直接执行
+			waiter.m_optCallback.emplace(token, CancelCallback{ this, &waiter });
+		}
+		return waiter.m_nGate.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	void Cancel(Waiter* pWaiter) noexcept
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			// 已经拿到许可时从链表上摘下来了，由交付的一方释放
+			if (!pWaiter->m_bQueued)
+			{
+				return;
+			}
+			Remove(pWaiter);
+			pWaiter->m_bCancelled = true;
+			m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+		pWaiter->Release();
+	}
+
+	// 有等待者时把能交付的许可都交付掉
+	void Notify() noexcept
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_nWaiters.load(std::memory_order_relaxed) == 0)
+		{
+			return;
+		}
+		Waiter* pWoken = nullptr;
+		{
+			std::lock_guard lock(m_lMutex);
+			while (m_pHead != nullptr && TryAcquire())
+			{
+				auto pWaiter = m_pHead;
+				Remove(pWaiter);
+				m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+				pWaiter->m_pNext = pWoken;
+				pWoken = pWaiter;
+			}
+		}
+		// 锁外恢复，释放之后节点可能已经被销毁了，要先取出下一个
+		while (pWoken != nullptr)
+		{
+			auto pWaiter = std::exchange(pWoken, pWoken->m_pNext);
+			pWaiter->Release();
+		}
+	}
+
+	// 先进先出的侵入式双向链表，只在持有锁时访问
+	void PushBack(Waiter* pWaiter) noexcept
+	{
+		pWaiter->m_pPrev = m_pTail;
+		pWaiter->m_pNext = nullptr;
+		pWaiter->m_bQueued = true;
+		(m_pTail != nullptr ? m_pTail->m_pNext : m_pHead) = pWaiter;
+		m_pTail = pWaiter;
+	}
+
+	void Remove(Waiter* pWaiter) noexcept
+	{
+		(pWaiter->m_pPrev != nullptr ? pWaiter->m_pPrev->m_pNext : m_pHead) = pWaiter->m_pNext;
+		(pWaiter->m_pNext != nullptr ? pWaiter->m_pNext->m_pPrev : m_pTail) = pWaiter->m_pPrev;
+		pWaiter->m_pPrev = pWaiter->m_pNext = nullptr;
+		pWaiter->m_bQueued = false;
+	}
+
+private:
+	static inline NoopExecutor s_InlineExecutor{};
+
+	std::atomic<std::size_t> m_nCount;
+
+	// 链表上等待者的个数，Release 之后不加锁地检查它
+	std::atomic<std::size_t> m_nWaiters{ 0 };
+	std::mutex m_lMutex;
+	Waiter* m_pHead = nullptr;
+	Waiter* m_pTail = nullptr;
+};
+
+
+/// ---------- Task Scope ----------
+/// 子 Task 的个数用一个原子计数器表示，初始值为 1，多出来的一个由 Join 持有
+/// 和 WhenAllCounter 一样，Join 释放自己的那一个之后，最后一个完成的子 Task 负责恢复等待方
+/// 子 Task 和它的通知节点放在一起，完成时由通知函数销毁，所以 scope 里不需要保存子 Task 的列表
+class TaskScope
+{
+	template <typename T>
+	struct Child
+	{
+		Task<T> m_Task;
+		TaskScope* m_pScope;
+		TaskContinuation<T> m_Continuation{};
+	};
+
+public:
+	static constexpr std::size_t kUnlimited = std::numeric_limits<std::size_t>::max();
+
+	template <typename T>
+	class SpawnAwaiter
+	{
+	public:
+		SpawnAwaiter(TaskScope* pScope, LazyTask<T>&& task) noexcept
+			: m_pScope(pScope), m_Task(std::move(task)), m_Acquire(pScope->m_Semaphore.Acquire()) {};
+
+		SpawnAwaiter(SpawnAwaiter&& awaiter) noexcept
+			: m_pScope(awaiter.m_pScope), m_Task(std::move(awaiter.m_Task)), m_Acquire(std::move(awaiter.m_Acquire)) {};
+
+		SpawnAwaiter& operator=(SpawnAwaiter&) = delete;
+
+		// 需要先从等待方的 promise 里取出调度器和 token，所以总是进入 await_suspend
+		bool await_ready() const noexcept { return false; }
+
+		template <typename TPromise>
+		bool await_suspend(std::coroutine_handle<TPromise> handle)
+		{
+			if constexpr (requires { handle.promise().GetExecutor(); })
+			{
+				m_pExecutor = handle.promise().GetExecutor();
+			}
+			m_tokStop = GetStopToken(handle);
+			// 还有空位时不挂起
+			if (!m_tokStop.stop_requested() && m_Acquire.await_ready())
+			{
+				return false;
+			}
+			return m_Acquire.await_suspend(handle);
+		}
+
+		// 取消时子 Task 不会启动，跟着 Awaiter 一起销毁
+		bool await_resume()
+		{
+			if (m_Acquire.IsCancelled())
+			{
+				return false;
+			}
+			m_pScope->Start(std::move(m_Task), *m_pExecutor, m_tokStop);
+			return true;
+		}
+
+	private:
+		TaskScope* m_pScope;
+		LazyTask<T> m_Task;
+		AsyncSemaphore::AcquireAwaiter m_Acquire;
+		AbstractExecutor* m_pExecutor = &ThreadPoolExecutor::Shared();
+		std::stop_token m_tokStop{};
+	};
+
+	class JoinAwaiter
+	{
+	public:
+		explicit JoinAwaiter(TaskScope* pScope) noexcept
+			: m_pScope(pScope) {};
+
+		bool await_ready() const noexcept
+		{
+			return m_pScope->m_nCount.load(std::memory_order_acquire) == 1;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			m_pScope->m_hJoiner = handle;
+			return m_pScope->m_nCount.fetch_sub(1, std::memory_order_acq_rel) != 1;
+		}
+
+		// 所有子 Task 都完成了，可以继续 Spawn，scope 可以重复使用
+		void await_resume()
+		{
+			m_pScope->m_nCount.store(1, std::memory_order_relaxed);
+			m_pScope->m_hJoiner = {};
+			if (auto pException = std::exchange(m_pScope->m_pException, nullptr))
+			{
+				m_pScope->m_bFailed.store(false, std::memory_order_relaxed);
+				std::rethrow_exception(pException);
+			}
+		}
+
+	private:
+		TaskScope* m_pScope;
+	};
+
+	// 同时执行的子 Task 不超过 nMaxConcurrency 个
+	explicit TaskScope(std::size_t nMaxConcurrency = kUnlimited) noexcept
+		: m_Semaphore(nMaxConcurrency > 0 ? nMaxConcurrency : 1) {};
+
+	TaskScope(TaskScope&) = delete;
+	TaskScope& operator=(TaskScope&) = delete;
+
+	~TaskScope()
+	{
+		if (m_nCount.load(std::memory_order_acquire) != 1)
+		{
+			std::terminate();
+		}
+	}
+
+	// 达到上限时挂起，直到有子 Task 完成
+	// co_await 之后返回 false 表示等待期间请求了取消，子 Task 没有启动
+	// 这里不抛出 OperationCancelled，否则异常会直接越过 Join 析构 scope
+	template <typename T>
+	SpawnAwaiter<T> Spawn(LazyTask<T> task) noexcept
+	{
+		return SpawnAwaiter<T>(this, std::move(task));
+	}
+
+	// 所有子 Task 都完成后恢复，子 Task 抛出的第一个异常在这里重新抛出，其余的被丢弃
+	JoinAwaiter Join() noexcept
+	{
+		return JoinAwaiter(this);
+	}
+
+	// 还没有完成的子 Task 个数
+	std::size_t Active() const noexcept
+	{
+		return m_nCount.load(std::memory_order_relaxed) - 1;
+	}
+
+private:
+	template <typename T>
+	void Start(LazyTask<T>&& task, AbstractExecutor& executor, const std::stop_token& token)
+	{
+		// 子 Task 随时可能完成，先计数再启动
+		m_nCount.fetch_add(1, std::memory_order_relaxed);
+		auto pChild = new Child<T>{ std::move(task).ScheduleOn(executor, token), this };
+		pChild->m_Continuation.m_pExecutor = &executor;
+		pChild->m_Continuation.m_pfnNotify = &TaskScope::OnCompleted<T>;
+		pChild->m_Continuation.m_pContext = pChild;
+		if (!pChild->m_Task.AddContinuation(&pChild->m_Continuation))
+		{
+			// 已经完成了，恢复等待方的只可能是 Join，而等待方现在正在执行 Spawn，所以不会有要恢复的协程
+			OnCompleted<T>(pChild);
+		}
+	}
+
+	// 子 Task 完成后，由它的 Complete 在挂起之后调用
+	template <typename T>
+	static std::coroutine_handle<> OnCompleted(void* pContext) noexcept
+	{
+		auto pChild = static_cast<Child<T>*>(pContext);
+		auto pScope = pChild->m_pScope;
+		try
+		{
+			pChild->m_Task.GetResult();
+		}
+		catch (...)
+		{
+			pScope->SetException(std::current_exception());
+		}
+		// 子 Task 已经停在 final_suspend 上，可以直接销毁
+		delete pChild;
+		pScope->m_Semaphore.Release();
+		// 最后一个完成的子 Task 负责恢复 Join，不是最后一个时 scope 随时可能被销毁，不能再访问
+		if (pScope->m_nCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			return pScope->m_hJoiner;
+		}
+		return std::noop_coroutine();
+	}
+
+	void SetException(std::exception_ptr pException) noexcept
+	{
+		if (!m_bFailed.exchange(true, std::memory_order_relaxed))
+		{
+			m_pException = std::move(pException);
+		}
+	}
+
+private:
+	AsyncSemaphore m_Semaphore;
+	std::atomic<std::size_t> m_nCount{ 1 };
+	std::coroutine_handle<> m_hJoiner{};
+
+	// 第一个失败的子 Task 的异常，计数器的 acq_rel 保证 Join 恢复之后能看到
+	std::atomic<bool> m_bFailed{ false };
+	std::exception_ptr m_pException{};
+};
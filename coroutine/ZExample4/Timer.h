@@ -0,0 +1,300 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "Cancellation.h"
+#include "Executor.h"
+
+/// 定时器
+/// 在协程里调用 std::this_thread::sleep_for 会让整个线程停下来，线程池里的一个线程就这样被占住了
+/// co_await SleepFor(duration) 只是把协程挂起，登记到定时器里，到期后再交给协程自己的调度器恢复
+/// 所有的定时都由同一个定时器线程负责，它用一个按到期时间排序的有序集合保存登记的协程
+/// 一百万个同时睡眠的协程只需要一百万个节点，而不是一百万个线程
+/// 集合而不是堆，是为了取消时能直接删掉对应的节点
+///
+///		Task<int> Retry()
+///		{
+///			co_await SleepFor(std::chrono::milliseconds(100));
+///			...
+///		}
+
+/// ---------- Timer Queue ----------
+class TimerQueue
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	TimerQueue()
+		: m_Thread([this]() {
+		Run();
+			}) {};
+
+	~TimerQueue()
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_bStopped = true;
+		}
+		m_conTimer.notify_one();
+		m_Thread.join();
+	}
+
+	TimerQueue(TimerQueue&) = delete;
+	TimerQueue& operator=(TimerQueue&) = delete;
+
+	// 登记后返回的编号，和到期时间一起用于取消
+	using TimerId = std::uint64_t;
+
+	// 到期后把协程交给 pExecutor 恢复
+	TimerId Schedule(Clock::time_point tpDeadline, std::coroutine_handle<> handle, AbstractExecutor* pExecutor)
+	{
+		return Insert(Entry{ tpDeadline, 0, handle, pExecutor, nullptr, nullptr });
+	}
+
+	// 到期后在定时器线程上调用 pfnExpire(pContext)，函数里不能阻塞
+	TimerId Schedule(Clock::time_point tpDeadline, void (*pfnExpire)(void* pContext), void* pContext)
+	{
+		return Insert(Entry{ tpDeadline, 0, {}, nullptr, pfnExpire, pContext });
+	}
+
+	// 返回 true 表示定时器还没有到期，已经删除，之后不会再触发
+	// 返回 false 表示已经到期被取走了（或者正在触发）
+	bool Cancel(Clock::time_point tpDeadline, TimerId nId)
+	{
+		std::lock_guard lock(m_lMutex);
+		return m_setTimers.erase(Entry{ tpDeadline, nId }) != 0;
+	}
+
+	std::size_t PendingCount()
+	{
+		std::lock_guard lock(m_lMutex);
+		return m_setTimers.size();
+	}
+
+	// 全局共享的定时器，SleepFor 默认登记到这里
+	static TimerQueue& Shared()
+	{
+		static TimerQueue timerQueue;
+		return timerQueue;
+	}
+
+private:
+	struct Entry
+	{
+		Clock::time_point m_tpDeadline;
+		// 到期时间相同时按登记的顺序触发
+		TimerId m_nSequence;
+		// 恢复协程，或者调用到期函数
+		std::coroutine_handle<> m_hCoroutine{};
+		AbstractExecutor* m_pExecutor = nullptr;
+		void (*m_pfnExpire)(void* pContext) = nullptr;
+		void* m_pContext = nullptr;
+
+		bool operator<(const Entry& entry) const
+		{
+			if (m_tpDeadline != entry.m_tpDeadline)
+			{
+				return m_tpDeadline < entry.m_tpDeadline;
+			}
+			return m_nSequence < entry.m_nSequence;
+		}
+	};
+
+	TimerId Insert(Entry&& entry)
+	{
+		bool bEarliest = false;
+		TimerId nId = 0;
+		{
+			std::lock_guard lock(m_lMutex);
+			nId = entry.m_nSequence = m_nSequence++;
+			auto it = m_setTimers.insert(std::move(entry)).first;
+			// 只有新的定时器排到了最前面，才需要叫醒定时器线程重新计算等待时间
+			bEarliest = it == m_setTimers.begin();
+		}
+		if (bEarliest)
+		{
+			m_conTimer.notify_one();
+		}
+		return nId;
+	}
+
+	void Run()
+	{
+		std::vector<Entry> vecExpired;
+		std::unique_lock lock(m_lMutex);
+		while (!m_bStopped)
+		{
+			if (m_setTimers.empty())
+			{
+				m_conTimer.wait(lock);
+				continue;
+			}
+			auto tpNow = Clock::now();
+			// 等待期间节点可能被取消删除，不能把节点里的引用交给 wait_until
+			auto tpEarliest = m_setTimers.begin()->m_tpDeadline;
+			if (tpEarliest > tpNow)
+			{
+				m_conTimer.wait_until(lock, tpEarliest);
+				continue;
+			}
+			// 一次取走所有到期的定时器，解锁后再交给调度器，不在锁里调用外部代码
+			// 取走之后 Cancel 就找不到它们了，触发和取消只有一方会成功
+			auto itEnd = m_setTimers.begin();
+			while (itEnd != m_setTimers.end() && itEnd->m_tpDeadline <= tpNow)
+			{
+				vecExpired.push_back(*itEnd++);
+			}
+			m_setTimers.erase(m_setTimers.begin(), itEnd);
+			lock.unlock();
+			for (auto& entry : vecExpired)
+			{
+				if (entry.m_pfnExpire != nullptr)
+				{
+					entry.m_pfnExpire(entry.m_pContext);
+				}
+				else
+				{
+					entry.m_pExecutor->Schedule(entry.m_hCoroutine);
+				}
+			}
+			vecExpired.clear();
+			lock.lock();
+		}
+	}
+
+private:
+	std::set<Entry> m_setTimers;
+	TimerId m_nSequence = 0;
+
+	std::mutex m_lMutex;
+	std::condition_variable m_conTimer;
+	bool m_bStopped = false;
+
+	// 最后初始化，线程启动时其他成员都已经准备好了
+	std::thread m_Thread;
+};
+
+/// ---------- Sleep Awaiter ----------
+/// 到期后协程回到 promise 的调度器上恢复，promise 需要提供 GetExecutor()
+/// 没有调度器的协程直接在定时器线程上恢复
+/// promise 提供了 GetStopToken() 时可以被取消：提前恢复，await_resume 抛出 OperationCancelled
+///
+/// 取消回调必须在登记到定时器之前就在 token 上登记好，而登记到定时器之后协程随时可能被恢复
+/// 所以用一个计数为 2 的门闩：到期（或者取消）的一方和 await_suspend 各释放一个
+/// 最后释放的一方负责恢复协程，await_suspend 执行完之前 Awaiter 一定不会被销毁
+class SleepAwaiter
+{
+public:
+	explicit SleepAwaiter(TimerQueue::Clock::time_point tpDeadline, TimerQueue& timerQueue = TimerQueue::Shared()) noexcept
+		: m_tpDeadline(tpDeadline), m_pTimerQueue(&timerQueue) {};
+
+	// 协程框架可能会在挂起之前复制 Awaiter，这时还没有登记任何东西
+	SleepAwaiter(const SleepAwaiter& awaiter) noexcept
+		: m_tpDeadline(awaiter.m_tpDeadline), m_pTimerQueue(awaiter.m_pTimerQueue) {};
+
+	SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+	bool await_ready() const noexcept
+	{
+		return m_tpDeadline <= TimerQueue::Clock::now();
+	}
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle)
+	{
+		m_hCoroutine = handle;
+		if constexpr (requires { handle.promise().GetExecutor(); })
+		{
+			m_pExecutor = handle.promise().GetExecutor();
+		}
+		auto token = GetStopToken(handle);
+		if (!token.stop_possible())
+		{
+			m_pTimerQueue->Schedule(m_tpDeadline, handle, m_pExecutor);
+			return true;
+		}
+		if (token.stop_requested())
+		{
+			m_bCancelled = true;
+			return false;
+		}
+		m_nTimerId = m_pTimerQueue->Schedule(m_tpDeadline, &SleepAwaiter::Expire, this);
+		// 已经请求过取消时回调会在这里直接执行
+		m_optCallback.emplace(token, CancelCallback{ this });
+		return m_nGate.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	void await_resume() const
+	{
+		if (m_bCancelled)
+		{
+			throw OperationCancelled();
+		}
+	}
+
+private:
+	struct CancelCallback
+	{
+		SleepAwaiter* m_pAwaiter;
+
+		void operator()() const noexcept
+		{
+			// 删除成功说明定时器还没有到期，由这里代替定时器线程释放
+			if (m_pAwaiter->m_pTimerQueue->Cancel(m_pAwaiter->m_tpDeadline, m_pAwaiter->m_nTimerId))
+			{
+				m_pAwaiter->m_bCancelled = true;
+				m_pAwaiter->Release();
+			}
+		}
+	};
+
+	static void Expire(void* pContext) noexcept
+	{
+		static_cast<SleepAwaiter*>(pContext)->Release();
+	}
+
+	void Release() noexcept
+	{
+		if (m_nGate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			// 恢复之后 Awaiter 随时可能被销毁，不能再访问成员
+			m_pExecutor->Schedule(m_hCoroutine);
+		}
+	}
+
+private:
+	static inline NoopExecutor s_InlineExecutor{};
+
+	TimerQueue::Clock::time_point m_tpDeadline;
+	TimerQueue* m_pTimerQueue;
+
+	std::coroutine_handle<> m_hCoroutine{};
+	AbstractExecutor* m_pExecutor = &s_InlineExecutor;
+	TimerQueue::TimerId m_nTimerId = 0;
+	std::atomic<int> m_nGate{ 2 };
+	bool m_bCancelled = false;
+	// 析构时从 token 上注销，回调正在别的线程上执行时会等它结束
+	std::optional<std::stop_callback<CancelCallback>> m_optCallback;
+};
+
+template <typename TRep, typename TPeriod>
+SleepAwaiter SleepFor(std::chrono::duration<TRep, TPeriod> duration)
+{
+	// 向上取整，不会比要求的时间醒得更早
+	return SleepAwaiter(TimerQueue::Clock::now() + std::chrono::ceil<TimerQueue::Clock::duration>(duration));
+}
+
+inline SleepAwaiter SleepUntil(TimerQueue::Clock::time_point tpDeadline)
+{
+	return SleepAwaiter(tpDeadline);
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Task.h"
+
+/// 并发等待多个 Task
+/// 依次 co_await 两个互不依赖的 Task，总耗时是两者之和
+/// Task 创建时就已经交给调度器开始执行了，只要不是一个个地等，它们本来就是并发的
+///		auto [result2, result3] = co_await WhenAll(SimpleTask2(), SimpleTask3());
+/// 总耗时就变成了两者中的最大值
+///
+/// WhenAll 和 WhenAny 本身也是 Task，在每个子 Task 上登记一个通知节点
+/// 节点放在 WhenAll/WhenAny 的协程帧里，不需要额外分配，也不用为每个子 Task 再包装一个协程
+
+/// ---------- WhenAll ----------
+/// 所有子 Task 共用一个原子计数器，初始值比子 Task 的数量多一
+/// 多出来的一个由等待方自己持有，登记完所有子 Task 后才释放
+/// 这样即使子 Task 在登记的过程中就完成了，也不会提前恢复等待方
+class WhenAllCounter
+{
+public:
+	explicit WhenAllCounter(std::size_t nCount) noexcept
+		: m_nCount(nCount + 1) {};
+
+	// 协程框架可能会在挂起之前移动 Awaiter，这时还没有任何子 Task 持有它
+	WhenAllCounter(WhenAllCounter&& counter) noexcept
+		: m_nCount(counter.m_nCount.load(std::memory_order_relaxed)) {};
+
+	template <typename TPromise>
+	void Start(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		m_hAwaiter = handle;
+		m_pExecutor = handle.promise().GetExecutor();
+	}
+
+	// 在子 Task 上登记通知节点，子 Task 已经完成时直接计数
+	template <typename T>
+	void Register(Task<T>& task, TaskContinuation<T>& continuation) noexcept
+	{
+		continuation.m_pExecutor = m_pExecutor;
+		continuation.m_pfnNotify = &WhenAllCounter::Notify;
+		continuation.m_pContext = this;
+		if (!task.AddContinuation(&continuation))
+		{
+			Arrive();
+		}
+	}
+
+	// 释放等待方持有的那一个计数，返回 true 表示还有子 Task 没有完成，需要挂起
+	bool Suspend() noexcept
+	{
+		return m_nCount.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+private:
+	// 最后一个完成的子 Task 负责恢复等待方
+	std::coroutine_handle<> Arrive() noexcept
+	{
+		if (m_nCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			return m_hAwaiter;
+		}
+		return std::noop_coroutine();
+	}
+
+	static std::coroutine_handle<> Notify(void* pContext) noexcept
+	{
+		return static_cast<WhenAllCounter*>(pContext)->Arrive();
+	}
+
+private:
+	std::atomic<std::size_t> m_nCount;
+	std::coroutine_handle<> m_hAwaiter{};
+	AbstractExecutor* m_pExecutor = nullptr;
+};
+
+/// 等待固定个数、类型各不相同的 Task
+template <typename ...Ts>
+class WhenAllAwaiter
+{
+public:
+	explicit WhenAllAwaiter(Task<Ts>&... tasks) noexcept
+		: m_tupTasks(tasks...), m_Counter(sizeof...(Ts)) {};
+
+	bool await_ready() const noexcept { return sizeof...(Ts) == 0; }
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		m_Counter.Start(handle);
+		RegisterAll(std::index_sequence_for<Ts...>{});
+		return m_Counter.Suspend();
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	template <std::size_t ...Is>
+	void RegisterAll(std::index_sequence<Is...>) noexcept
+	{
+		(m_Counter.Register(std::get<Is>(m_tupTasks), std::get<Is>(m_tupContinuations)), ...);
+	}
+
+private:
+	std::tuple<Task<Ts>&...> m_tupTasks;
+	std::tuple<TaskContinuation<Ts>...> m_tupContinuations{};
+	WhenAllCounter m_Counter;
+};
+
+/// 等待一组同类型的 Task
+template <typename T>
+class WhenAllRangeAwaiter
+{
+public:
+	explicit WhenAllRangeAwaiter(std::vector<Task<T>>& tasks)
+		: m_vecTasks(tasks), m_vecContinuations(tasks.size()), m_Counter(tasks.size()) {};
+
+	bool await_ready() const noexcept { return m_vecTasks.empty(); }
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		m_Counter.Start(handle);
+		for (std::size_t i = 0; i < m_vecTasks.size(); ++i)
+		{
+			m_Counter.Register(m_vecTasks[i], m_vecContinuations[i]);
+		}
+		return m_Counter.Suspend();
+	}
+
+	void await_resume() const noexcept {}
+
+private:
+	std::vector<Task<T>>& m_vecTasks;
+	std::vector<TaskContinuation<T>> m_vecContinuations;
+	WhenAllCounter m_Counter;
+};
+
+/// Task<void> 在 tuple 中占一个 std::monostate 的位置，其余子 Task 的下标不变
+template <typename T>
+using WhenAllResult = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+// Task<void> 也要取一次结果，它抛出的异常才能传出去
+template <typename T>
+WhenAllResult<T> TakeWhenAllResult(Task<T>& task)
+{
+	if constexpr (std::is_void_v<T>)
+	{
+		task.GetResult();
+		return {};
+	}
+	else
+	{
+		return task.GetResult();
+	}
+}
+
+/// 所有子 Task 都完成后返回它们的结果，顺序和参数顺序一致
+/// 有子 Task 抛出异常时，WhenAll 抛出排在最前面的那一个
+template <typename ...Ts>
+Task<std::tuple<WhenAllResult<Ts>...>> WhenAll(Task<Ts>... tasks)
+{
+	co_await WhenAllAwaiter<Ts...>(tasks...);
+	// 花括号初始化保证从左到右求值
+	co_return std::tuple<WhenAllResult<Ts>...>{ TakeWhenAllResult(tasks)... };
+}
+
+template <typename T>
+	requires (!std::is_void_v<T>)
+Task<std::vector<T>> WhenAll(std::vector<Task<T>> tasks)
+{
+	co_await WhenAllRangeAwaiter<T>(tasks);
+	std::vector<T> results;
+	results.reserve(tasks.size());
+	for (auto& task : tasks)
+	{
+		results.push_back(task.GetResult());
+	}
+	co_return results;
+}
+
+/// 一组 Task<void> 没有结果可以收集，全部完成后返回
+inline Task<void> WhenAll(std::vector<Task<void>> tasks)
+{
+	co_await WhenAllRangeAwaiter<void>(tasks);
+	for (auto& task : tasks)
+	{
+		task.GetResult();
+	}
+}
+
+
+/// ---------- WhenAny ----------
+/// 第一个完成的子 Task 恢复等待方，其余的子 Task 继续执行直到完成
+/// 所以子 Task 和通知节点都放在堆上的共享状态里，用引用计数管理：
+/// 每个子 Task 完成时释放一个，等待方取走结果后释放一个，最后一个释放的负责销毁
+/// 另外用一个计数为 2 的门闩保证等待方登记完所有子 Task 之后，胜出的子 Task 才能恢复它
+
+/// Task<void> 没有结果，只返回胜出的下标
+template <typename T>
+using WhenAnyResult = std::conditional_t<std::is_void_v<T>, std::size_t, std::pair<std::size_t, T>>;
+
+template <typename T>
+class WhenAnyState
+{
+	struct Node
+	{
+		TaskContinuation<T> m_Continuation{};
+		WhenAnyState* m_pState = nullptr;
+		std::size_t m_nIndex = 0;
+	};
+
+public:
+	explicit WhenAnyState(std::vector<Task<T>>&& tasks)
+		: m_vecTasks(std::move(tasks)), m_vecNodes(m_vecTasks.size()), m_nRefCount(m_vecTasks.size() + 1) {};
+
+	template <typename TPromise>
+	bool Suspend(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		m_hAwaiter = handle;
+		for (std::size_t i = 0; i < m_vecTasks.size(); ++i)
+		{
+			auto& node = m_vecNodes[i];
+			node.m_pState = this;
+			node.m_nIndex = i;
+			node.m_Continuation.m_pExecutor = handle.promise().GetExecutor();
+			node.m_Continuation.m_pfnNotify = &WhenAnyState::Notify;
+			node.m_Continuation.m_pContext = &node;
+			if (!m_vecTasks[i].AddContinuation(&node.m_Continuation))
+			{
+				// 门闩还没有打开，这里不会返回等待方
+				Notify(&node);
+			}
+		}
+		return m_nGate.fetch_sub(1, std::memory_order_acq_rel) != 1;
+	}
+
+	WhenAnyResult<T> GetResult()
+	{
+		if constexpr (std::is_void_v<T>)
+		{
+			m_vecTasks[m_nWinner].GetResult();
+			return m_nWinner;
+		}
+		else
+		{
+			return { m_nWinner, m_vecTasks[m_nWinner].GetResult() };
+		}
+	}
+
+	void Release() noexcept
+	{
+		if (m_nRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete this;
+		}
+	}
+
+private:
+	static std::coroutine_handle<> Notify(void* pContext) noexcept
+	{
+		auto pNode = static_cast<Node*>(pContext);
+		auto pState = pNode->m_pState;
+		std::coroutine_handle<> hNext = std::noop_coroutine();
+		if (!pState->m_bFinished.exchange(true, std::memory_order_acq_rel))
+		{
+			pState->m_nWinner = pNode->m_nIndex;
+			if (pState->m_nGate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				hNext = pState->m_hAwaiter;
+			}
+		}
+		// 之后节点可能已经被释放了
+		pState->Release();
+		return hNext;
+	}
+
+private:
+	std::vector<Task<T>> m_vecTasks;
+	std::vector<Node> m_vecNodes;
+
+	std::atomic<std::size_t> m_nRefCount;
+	std::atomic<bool> m_bFinished{ false };
+	std::atomic<int> m_nGate{ 2 };
+	std::size_t m_nWinner = 0;
+	std::coroutine_handle<> m_hAwaiter{};
+};
+
+template <typename T>
+class WhenAnyAwaiter
+{
+public:
+	explicit WhenAnyAwaiter(std::vector<Task<T>>&& tasks)
+		: m_pState(new WhenAnyState<T>(std::move(tasks))) {};
+
+	WhenAnyAwaiter(WhenAnyAwaiter&& awaiter) noexcept
+		: m_pState(std::exchange(awaiter.m_pState, nullptr)) {};
+
+	WhenAnyAwaiter(WhenAnyAwaiter&) = delete;
+	WhenAnyAwaiter& operator=(WhenAnyAwaiter&) = delete;
+
+	~WhenAnyAwaiter()
+	{
+		if (m_pState != nullptr)
+		{
+			m_pState->Release();
+		}
+	}
+
+	bool await_ready() const noexcept { return false; }
+
+	template <typename TPromise>
+	bool await_suspend(std::coroutine_handle<TPromise> handle) noexcept
+	{
+		return m_pState->Suspend(handle);
+	}
+
+	WhenAnyResult<T> await_resume()
+	{
+		return m_pState->GetResult();
+	}
+
+private:
+	WhenAnyState<T>* m_pState;
+};
+
+/// 返回第一个完成的子 Task 的下标和结果，它抛出异常时 WhenAny 也抛出这个异常
+template <typename T>
+Task<WhenAnyResult<T>> WhenAny(std::vector<Task<T>> tasks)
+{
+	if (tasks.empty())
+	{
+		throw std::invalid_argument("WhenAny requires at least one task");
+	}
+	co_return co_await WhenAnyAwaiter<T>(std::move(tasks));
+}
+
+template <typename T, typename ...TRest>
+	requires (std::is_same_v<T, TRest> && ...)
+Task<WhenAnyResult<T>> WhenAny(Task<T> task, Task<TRest>... rest)
+{
+	std::vector<Task<T>> tasks;
+	tasks.reserve(1 + sizeof...(TRest));
+	tasks.push_back(std::move(task));
+	(tasks.push_back(std::move(rest)), ...);
+	return WhenAny(std::move(tasks));
+}
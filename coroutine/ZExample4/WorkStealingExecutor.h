@@ -0,0 +1,421 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Executor.h"
+
+/// 工作窃取调度器
+/// ThreadPoolExecutor 所有线程共用一个加锁的队列，短小的协程一多，锁就成了瓶颈
+/// 这里每个线程都有一个自己的双端队列（Chase-Lev Deque）
+///		1. 自己从队列底部压入和弹出，不需要加锁
+///		2. 自己没活干时，从别的线程队列的顶部偷一个过来
+/// 另外每个线程还有一个 LIFO 槽位，存放刚刚被唤醒的协程
+/// 在工作线程上调度协程时（例如刚创建的子 Task、跨调度器恢复的等待方）
+/// 协程会直接放进当前线程的槽位里，紧接着在同一个线程上执行，这时它需要的数据大概率还在缓存里
+
+
+/// ---------- Chase-Lev Deque ----------
+/// 单生产者（所有者线程）多消费者的无锁双端队列
+/// 参考 Lê, Pop, Cohen, Nardelli 《Correct and Efficient Work-Stealing for Weak Memory Models》
+template <typename T>
+class ChaseLevDeque
+{
+	static_assert(std::is_trivially_copyable_v<T>, "ChaseLevDeque 只能存放可以按位复制的类型");
+
+	/// 环形数组，容量总是 2 的幂
+	class Ring
+	{
+	public:
+		explicit Ring(std::int64_t nCapacity)
+			: m_nCapacity(nCapacity), m_pBuffer(new std::atomic<T>[nCapacity]) {};
+
+		std::int64_t Capacity() const { return m_nCapacity; }
+
+		T Load(std::int64_t i) const
+		{
+			return m_pBuffer[i & (m_nCapacity - 1)].load(std::memory_order_relaxed);
+		}
+
+		void Store(std::int64_t i, T value)
+		{
+			m_pBuffer[i & (m_nCapacity - 1)].store(value, std::memory_order_relaxed);
+		}
+
+		// 扩容一倍，并把 [top, bottom) 中的元素复制过去
+		Ring* Grow(std::int64_t nBottom, std::int64_t nTop) const
+		{
+			auto pRing = new Ring(m_nCapacity * 2);
+			for (auto i = nTop; i < nBottom; ++i)
+			{
+				pRing->Store(i, Load(i));
+			}
+			return pRing;
+		}
+
+	private:
+		std::int64_t m_nCapacity;
+		std::unique_ptr<std::atomic<T>[]> m_pBuffer;
+	};
+
+public:
+	explicit ChaseLevDeque(std::int64_t nCapacity = 256)
+		: m_pRing(new Ring(nCapacity))
+	{
+		m_vecRings.emplace_back(m_pRing.load(std::memory_order_relaxed));
+	}
+
+	ChaseLevDeque(ChaseLevDeque&) = delete;
+	ChaseLevDeque& operator=(ChaseLevDeque&) = delete;
+
+	/// 只能由所有者线程调用
+	void Push(T value)
+	{
+		auto b = m_nBottom.load(std::memory_order_relaxed);
+		auto t = m_nTop.load(std::memory_order_acquire);
+		auto pRing = m_pRing.load(std::memory_order_relaxed);
+		if (b - t > pRing->Capacity() - 1)
+		{
+			// 旧的数组可能还有窃取者在读，所以不能马上释放，等队列析构时一起释放
+			pRing = pRing->Grow(b, t);
+			m_vecRings.emplace_back(pRing);
+			m_pRing.store(pRing, std::memory_order_release);
+		}
+		pRing->Store(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_nBottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	/// 只能由所有者线程调用，从底部弹出（后进先出）
+	std::optional<T> Pop()
+	{
+		auto b = m_nBottom.load(std::memory_order_relaxed) - 1;
+		auto pRing = m_pRing.load(std::memory_order_relaxed);
+		m_nBottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto t = m_nTop.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			// 队列是空的
+			m_nBottom.store(b + 1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		auto value = pRing->Load(b);
+		if (t == b)
+		{
+			// 只剩最后一个元素，要和窃取者抢
+			bool bWon = m_nTop.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed);
+			m_nBottom.store(b + 1, std::memory_order_relaxed);
+			if (!bWon)
+			{
+				return std::nullopt;
+			}
+		}
+		return value;
+	}
+
+	/// 任意线程都可以调用，从顶部偷走一个（先进先出）
+	std::optional<T> Steal()
+	{
+		auto t = m_nTop.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto b = m_nBottom.load(std::memory_order_acquire);
+		if (t >= b)
+		{
+			return std::nullopt;
+		}
+
+		auto pRing = m_pRing.load(std::memory_order_acquire);
+		auto value = pRing->Load(t);
+		if (!m_nTop.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			// 被别人抢先了
+			return std::nullopt;
+		}
+		return value;
+	}
+
+	bool Empty() const
+	{
+		auto b = m_nBottom.load(std::memory_order_seq_cst);
+		auto t = m_nTop.load(std::memory_order_seq_cst);
+		return t >= b;
+	}
+
+	/// 近似的元素个数，只用于统计
+	std::size_t Size() const
+	{
+		auto b = m_nBottom.load(std::memory_order_relaxed);
+		auto t = m_nTop.load(std::memory_order_relaxed);
+		return b > t ? static_cast<std::size_t>(b - t) : 0;
+	}
+
+private:
+	std::atomic<std::int64_t> m_nTop{ 0 };
+	std::atomic<std::int64_t> m_nBottom{ 0 };
+	std::atomic<Ring*> m_pRing;
+
+	// 所有分配过的数组，只有所有者线程会修改
+	std::vector<std::unique_ptr<Ring>> m_vecRings;
+};
+
+
+/// ---------- Work Stealing Executor ----------
+class WorkStealingExecutor : public AbstractExecutor
+{
+	/// 每个工作线程的私有状态
+	struct Worker
+	{
+		WorkStealingExecutor* m_pOwner = nullptr;
+		// 刚被唤醒的协程，只有所有者线程会访问
+		std::coroutine_handle<> m_hLifoSlot{};
+		// 连续从 LIFO 槽位执行的次数，防止两个协程互相唤醒把队列里其他人饿死
+		int m_nLifoStreak = 0;
+		ChaseLevDeque<std::coroutine_handle<>> m_Deque;
+	};
+
+	// 连续执行 LIFO 槽位的上限，超过后槽位里的协程改为放入队列
+	static constexpr int kMaxLifoStreak = 16;
+
+public:
+	explicit WorkStealingExecutor(std::size_t nThreadCount = std::thread::hardware_concurrency())
+	{
+		if (nThreadCount == 0)
+		{
+			nThreadCount = 1;
+		}
+		// 线程启动前把所有 Worker 都建好，窃取时遍历 m_vecWorkers 不需要加锁
+		for (std::size_t i = 0; i < nThreadCount; ++i)
+		{
+			m_vecWorkers.emplace_back(std::make_unique<Worker>());
+			m_vecWorkers.back()->m_pOwner = this;
+		}
+		m_vecThreads.reserve(nThreadCount);
+		for (std::size_t i = 0; i < nThreadCount; ++i)
+		{
+			m_vecThreads.emplace_back([this, i]() {
+				WorkerLoop(*m_vecWorkers[i], i);
+				});
+		}
+	}
+
+	~WorkStealingExecutor()
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_bStopped = true;
+			++m_nWakeEpoch;
+		}
+		m_conSleep.notify_all();
+		for (auto& thread : m_vecThreads)
+		{
+			thread.join();
+		}
+	}
+
+	WorkStealingExecutor(WorkStealingExecutor&) = delete;
+	WorkStealingExecutor& operator=(WorkStealingExecutor&) = delete;
+
+	/// 普通的逻辑从外部注入队列进入，这不是热路径
+	void Execute(std::function<void()>&& func) override
+	{
+		{
+			std::lock_guard lock(m_lMutex);
+			m_dequeInjected.push_back(std::move(func));
+		}
+		WakeOne();
+	}
+
+	/// 在自己的工作线程上恢复协程时，直接放进 LIFO 槽位，不需要任何同步
+	/// 从外部线程恢复时则走注入队列
+	void Schedule(std::coroutine_handle<> handle) override
+	{
+		auto pWorker = s_pCurrentWorker;
+		if (pWorker == nullptr || pWorker->m_pOwner != this)
+		{
+			Execute([handle]() {
+				handle.resume();
+				});
+			return;
+		}
+
+		// 槽位里原来的协程让出来放进队列，可以被其他线程偷走
+		if (auto hPrevious = std::exchange(pWorker->m_hLifoSlot, handle))
+		{
+			pWorker->m_Deque.Push(hPrevious);
+			WakeOne();
+		}
+	}
+
+	std::size_t ThreadCount() const
+	{
+		return m_vecThreads.size();
+	}
+
+	bool IsInWorkerThread() const override
+	{
+		return s_pCurrentWorker != nullptr && s_pCurrentWorker->m_pOwner == this;
+	}
+
+	static WorkStealingExecutor& Shared()
+	{
+		static WorkStealingExecutor executor;
+		return executor;
+	}
+
+private:
+	void WorkerLoop(Worker& worker, std::size_t nIndex)
+	{
+		s_pCurrentWorker = &worker;
+		std::minstd_rand random(static_cast<std::uint32_t>(nIndex + 1));
+
+		while (true)
+		{
+			if (RunOnce(worker, random))
+			{
+				continue;
+			}
+
+			std::unique_lock lock(m_lMutex);
+			// 先登记为睡眠，再检查一遍有没有活，和 WakeOne 配合不会丢失唤醒
+			m_nSleeping.fetch_add(1, std::memory_order_seq_cst);
+			if (HasWork())
+			{
+				m_nSleeping.fetch_sub(1, std::memory_order_relaxed);
+				continue;
+			}
+			if (m_bStopped)
+			{
+				m_nSleeping.fetch_sub(1, std::memory_order_relaxed);
+				break;
+			}
+			auto nEpoch = m_nWakeEpoch;
+			m_conSleep.wait(lock, [this, nEpoch]() {
+				return m_nWakeEpoch != nEpoch;
+				});
+			m_nSleeping.fetch_sub(1, std::memory_order_relaxed);
+		}
+		s_pCurrentWorker = nullptr;
+	}
+
+	/// 按 LIFO 槽位 -> 自己的队列 -> 注入队列 -> 其他线程的队列 的顺序找一个执行
+	bool RunOnce(Worker& worker, std::minstd_rand& random)
+	{
+		if (auto handle = std::exchange(worker.m_hLifoSlot, {}))
+		{
+			if (++worker.m_nLifoStreak <= kMaxLifoStreak)
+			{
+				handle.resume();
+				return true;
+			}
+			worker.m_Deque.Push(handle);
+		}
+		worker.m_nLifoStreak = 0;
+
+		if (auto handle = worker.m_Deque.Pop())
+		{
+			if constexpr (kCoroutineInstrumentation)
+			{
+				CoroutineMetrics::RecordQueueDepth(worker.m_Deque.Size());
+			}
+			handle->resume();
+			return true;
+		}
+
+		std::function<void()> func;
+		{
+			std::lock_guard lock(m_lMutex);
+			if (!m_dequeInjected.empty())
+			{
+				func = std::move(m_dequeInjected.front());
+				m_dequeInjected.pop_front();
+				CoroutineMetrics::RecordQueueDepth(m_dequeInjected.size());
+			}
+		}
+		if (func)
+		{
+			func();
+			return true;
+		}
+
+		// 从随机位置开始偷，避免所有线程都盯着同一个队列
+		auto nCount = m_vecWorkers.size();
+		auto nStart = random() % nCount;
+		for (std::size_t i = 0; i < nCount; ++i)
+		{
+			auto& victim = *m_vecWorkers[(nStart + i) % nCount];
+			if (&victim == &worker)
+			{
+				continue;
+			}
+			if (auto handle = victim.m_Deque.Steal())
+			{
+				handle->resume();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// 需要持有 m_lMutex 调用
+	bool HasWork() const
+	{
+		if (!m_dequeInjected.empty())
+		{
+			return true;
+		}
+		for (auto& pWorker : m_vecWorkers)
+		{
+			if (!pWorker->m_Deque.Empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WakeOne()
+	{
+		// 保证刚才压入的任务先于读取 m_nSleeping 对其他线程可见
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_nSleeping.load(std::memory_order_seq_cst) == 0)
+		{
+			return;
+		}
+		{
+			std::lock_guard lock(m_lMutex);
+			++m_nWakeEpoch;
+		}
+		m_conSleep.notify_one();
+	}
+
+private:
+	static inline thread_local Worker* s_pCurrentWorker = nullptr;
+
+	std::vector<std::unique_ptr<Worker>> m_vecWorkers;
+	std::vector<std::thread> m_vecThreads;
+
+	// 外部线程提交的逻辑
+	std::deque<std::function<void()>> m_dequeInjected;
+
+	std::mutex m_lMutex;
+	std::condition_variable m_conSleep;
+	std::atomic<std::size_t> m_nSleeping{ 0 };
+	std::uint64_t m_nWakeEpoch = 0;
+	bool m_bStopped = false;
+};
@@ -0,0 +1,495 @@
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory_resource>
+#include <numeric>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncGenerator.h"
+#include "AsyncIo.h"
+#include "Channel.h"
+#include "GeneratorChunk.h"
+#include "GeneratorFile.h"
+#include "GeneratorPipe.h"
+#include "GeneratorParallel.h"
+#include "LazyTask.h"
+#include "Task.h"
+#include "TaskScope.h"
+#include "Timer.h"
+#include "WhenAll.h"
+#include "WorkStealingExecutor.h"
+
+/// 本例中，我们给 Task 加上调度器
+/// 协程默认运行在全局线程池 ThreadPoolExecutor::Shared() 上
+/// co_await 子 Task 时，子 Task 完成后当前协程会回到自己的调度器上恢复
+/// 互不依赖的 Task 因此可以在不同的线程上并行执行
+
+Task<int> SimpleTask2()
+{
+	std::cout << "task 2 start on " << std::this_thread::get_id() << std::endl;
+	// 只挂起协程，不占用线程
+	co_await SleepFor(std::chrono::seconds(1));
+	std::cout << "task 2 return after 1s" << std::endl;
+	co_return 2;
+}
+
+Task<int> SimpleTask3()
+{
+	std::cout << "task 3 start on " << std::this_thread::get_id() << std::endl;
+	co_await SleepFor(std::chrono::seconds(2));
+	std::cout << "task 3 return after 2s" << std::endl;
+	co_return 3;
+}
+
+Task<int> SimpleTask()
+{
+	std::cout << "task start" << std::endl;
+	auto result2 = co_await SimpleTask2();
+	std::cout << "returns from task2: " << result2 << std::endl;
+	auto result3 = co_await SimpleTask3();
+	std::cout << "returns from task3: " << result3 << std::endl;
+	co_return 1 + result2 + result3;
+}
+
+/// 两个子 Task 同时开始，一起等待，总共只需要 2s
+Task<int> ConcurrentTask()
+{
+	auto [result2, result3] = co_await WhenAll(SimpleTask2(), SimpleTask3());
+	std::cout << "returns from task2 and task3: " << result2 << ", " << result3 << std::endl;
+	// 谁先完成就用谁的结果
+	auto [index, first] = co_await WhenAny(SimpleTask2(), SimpleTask3());
+	std::cout << "first finished: task" << index + 2 << " -> " << first << std::endl;
+	co_return 1 + result2 + result3;
+}
+
+/// 没有返回值的 Task
+Task<void> PrintTask(int value)
+{
+	std::cout << "print task: " << value << std::endl;
+	co_return;
+}
+
+/// 第一个参数是调度器时，协程运行在指定的调度器上
+/// 这里用 NoopExecutor，协程就像之前的例子一样直接在调用方的线程上执行
+Task<int> InlineTask([[maybe_unused]] AbstractExecutor& executor)
+{
+	std::cout << "inline task on " << std::this_thread::get_id() << std::endl;
+	co_return 0;
+}
+
+/// 大量短小的 Task 互相等待时，换成工作窃取调度器
+/// 子 Task 完成后，等待方会被放进当前线程的 LIFO 槽位里紧接着执行
+Task<long> ParallelSum(AbstractExecutor& executor, int begin, int end)
+{
+	if (end - begin <= 16)
+	{
+		long sum = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			sum += i;
+		}
+		co_return sum;
+	}
+	auto mid = begin + (end - begin) / 2;
+	auto left = ParallelSum(executor, begin, mid);
+	auto right = ParallelSum(executor, mid, end);
+	auto leftSum = co_await std::move(left);
+	auto rightSum = co_await std::move(right);
+	co_return leftSum + rightSum;
+}
+
+/// 延迟启动的版本，整棵树先搭好，ScheduleOn 之后才开始执行
+/// 子 Task 继承等待方的调度器，在同一个线程上直接开始执行，不需要经过调度器的队列
+LazyTask<long> LazySum(int begin, int end)
+{
+	if (end - begin <= 16)
+	{
+		long sum = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			sum += i;
+		}
+		co_return sum;
+	}
+	auto mid = begin + (end - begin) / 2;
+	co_return co_await LazySum(begin, mid) + co_await LazySum(mid, end);
+}
+
+/// 可以被取消的 Task，token 作为参数传入，co_await 的 LazyTask 继承同一个 token
+/// 请求取消后正在等待的 SleepFor 提前恢复，抛出 OperationCancelled
+LazyTask<int> SlowStep()
+{
+	co_await SleepFor(std::chrono::seconds(10));
+	co_return 1;
+}
+
+Task<int> CancellableTask([[maybe_unused]] std::stop_token token)
+{
+	try
+	{
+		co_return co_await SlowStep();
+	}
+	catch (OperationCancelled&)
+	{
+		co_return -1;
+	}
+}
+
+/// 无限的 Generator，只能靠取消停下来
+Generator<int> Naturals()
+{
+	for (int i = 0;; ++i)
+	{
+		co_yield i;
+	}
+}
+
+/// 通过有界的 Channel 在不同线程上的协程之间传递数据，通道满了生产者就挂起等消费者
+Task<void> Producer([[maybe_unused]] AbstractExecutor& executor, Channel<int>& channel, int count)
+{
+	for (int i = 1; i <= count; ++i)
+	{
+		co_await channel.Send(i);
+	}
+	channel.Close();
+}
+
+Task<long> Consumer([[maybe_unused]] AbstractExecutor& executor, Channel<int>& channel)
+{
+	long sum = 0;
+	while (auto value = co_await channel.Recv())
+	{
+		sum += *value;
+	}
+	co_return sum;
+}
+
+/// 异步 Generator：两次 co_yield 之间可以 co_await 别的 Task
+/// 消费方处理当前的值时，生产方已经在调度器上准备下一个
+Task<std::size_t> NameLength(std::string name)
+{
+	co_return name.size();
+}
+
+AsyncGenerator<std::string> Greetings([[maybe_unused]] AbstractExecutor& executor, const std::vector<std::string>& names)
+{
+	for (auto& name : names)
+	{
+		// 左值 co_yield 传出的是副本，names 里的字符串不会被移走
+		co_yield name;
+		co_yield std::to_string(co_await NameLength(name));
+	}
+}
+
+Task<std::string> JoinGreetings(AbstractExecutor& executor, const std::vector<std::string>& names)
+{
+	std::string result;
+	auto greetings = Greetings(executor, names);
+	while (auto value = co_await greetings.next())
+	{
+		result += *value;
+		result += ' ';
+	}
+	co_return result;
+}
+
+/// 每个元素一个子 Task，同时最多 8 个在执行，子 Task 都完成后才返回
+LazyTask<void> Square(std::atomic<long>& total, int i)
+{
+	total.fetch_add(static_cast<long>(i) * i, std::memory_order_relaxed);
+	co_return;
+}
+
+Task<long> ScopedSquares([[maybe_unused]] AbstractExecutor& executor, int count)
+{
+	std::atomic<long> total{ 0 };
+	TaskScope scope(8);
+	for (int i = 0; i < count; ++i)
+	{
+		co_await scope.Spawn(Square(total, i));
+	}
+	co_await scope.Join();
+	co_return total.load(std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+/// 运行在事件循环上的 Task，I/O 完成后直接在事件循环线程上恢复
+Task<std::size_t> PingPong(EventLoopExecutor& loop, int writeFd, int readFd)
+{
+	const char message[] = "ping";
+	co_await AsyncWrite(loop, writeFd, std::as_bytes(std::span(message)));
+	std::byte buffer[16];
+	co_return co_await AsyncRead(loop, readFd, buffer);
+}
+
+/// 生产方运行在事件循环上，每个值之前等一次定时器，相当于在等 I/O
+AsyncGenerator<int> Ticks([[maybe_unused]] EventLoopExecutor& loop, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		co_await SleepFor(std::chrono::milliseconds(1));
+		co_yield i;
+	}
+}
+
+/// 消费方运行在线程池上，每个值都回到线程池上处理，不占用事件循环线程
+/// 返回在事件循环线程上处理的值的个数，应该是 0
+Task<int> ConsumeTicks([[maybe_unused]] AbstractExecutor& executor, EventLoopExecutor& loop, int count)
+{
+	auto ticks = Ticks(loop, count);
+	int nOnLoop = 0;
+	while (auto tick = co_await ticks.next())
+	{
+		nOnLoop += loop.IsInLoopThread() ? 1 : 0;
+	}
+	co_return nOnLoop;
+}
+
+/// 映射文件后逐行过滤，写进另一个文件，整个过程不复制行内容
+void FilterErrors(const std::string& input, const std::string& output)
+{
+	MappedFile file(input);
+	auto lines = mapped_lines(file);
+	auto errors = lines.filter([](std::string_view line) { return line.contains(" 500 "); });
+	BufferedFileSink sink(output);
+	errors.for_each(std::ref(sink));
+	sink.Flush();
+}
+#endif
+
+/// 通过 std::allocator_arg 指定 memory_resource，协程帧就从这块内存中分配
+Task<int> ArenaTask(std::allocator_arg_t, [[maybe_unused]] std::pmr::memory_resource* pResource, int value)
+{
+	co_return value * 2;
+}
+
+int main()
+{
+	std::cout << "main on " << std::this_thread::get_id() << std::endl;
+
+	NoopExecutor noopExecutor;
+	InlineTask(noopExecutor).GetResult();
+	PrintTask(7).GetResult();
+
+	/// 两个互不依赖的 Task 在线程池上同时运行，总共只需要 2s
+	auto start = std::chrono::steady_clock::now();
+	auto task2 = SimpleTask2();
+	auto task3 = SimpleTask3();
+	auto sum = task2.GetResult() + task3.GetResult();
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	std::cout << "parallel tasks: " << sum << " in " << elapsed.count() << "ms" << std::endl;
+
+	auto simpleTask = SimpleTask();
+	simpleTask.Then([](int i) {
+		std::cout << "simpleTask end: " << i << std::endl;
+		})
+		.Catching([](std::exception& e) {
+		std::cout << "error occurred: " << e.what() << std::endl;
+			});
+	try
+	{
+		auto i = simpleTask.GetResult();
+		std::cout << "simple task end from get: " << i << std::endl;
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "error: " << e.what() << std::endl;
+	}
+
+	start = std::chrono::steady_clock::now();
+	auto concurrent = ConcurrentTask().GetResult();
+	elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	std::cout << "concurrent task: " << concurrent << " in " << elapsed.count() << "ms" << std::endl;
+
+	{
+		/// 一次请求中的协程帧都放进同一块 arena，arena 析构时统一释放
+		std::pmr::monotonic_buffer_resource arena;
+		int total = 0;
+		for (int i = 0; i < 10; ++i)
+		{
+			total += ArenaTask(std::allocator_arg, &arena, i).GetResult();
+		}
+		std::cout << "arena tasks: " << total << std::endl;
+	}
+
+	std::cout << "parallel sum: " << ParallelSum(WorkStealingExecutor::Shared(), 0, 100000).GetResult() << std::endl;
+	{
+		std::vector<int> values(100000);
+		std::iota(values.begin(), values.end(), 0);
+		auto foldSum = parallel_fold(WorkStealingExecutor::Shared(), std::span(values), 0L,
+			[](long acc, int i) { return acc + i; },
+			[](long a, long b) { return a + b; }).GetResult();
+		std::cout << "parallel fold: " << foldSum << std::endl;
+	}
+	auto lazySum = LazySum(0, 100000);
+	std::cout << "lazy sum: " << std::move(lazySum).ScheduleOn(WorkStealingExecutor::Shared()).GetResult() << std::endl;
+
+	{
+		Channel<int> channel(16);
+		auto consumer = Consumer(WorkStealingExecutor::Shared(), channel);
+		auto producer = Producer(WorkStealingExecutor::Shared(), channel, 10000);
+		producer.GetResult();
+		std::cout << "channel sum: " << consumer.GetResult() << std::endl;
+	}
+	{
+		std::vector<std::string> names{ "alice", "bob", "carol" };
+		auto greetings = JoinGreetings(WorkStealingExecutor::Shared(), names).GetResult();
+		if (names[0] != "alice" || names[1] != "bob" || names[2] != "carol")
+		{
+			std::cerr << "async generator moved from the producer's objects" << std::endl;
+			return 1;
+		}
+		std::cout << "async generator: " << greetings << std::endl;
+	}
+	std::cout << "scoped squares: " << ScopedSquares(WorkStealingExecutor::Shared(), 1000).GetResult() << std::endl;
+
+	{
+		/// 缓冲区只有 4 个位置，后台任务会反复因为缓冲区满而退出，再由消费者重新调度
+		std::vector<int> values(10000);
+		std::iota(values.begin(), values.end(), 1);
+		auto source = Generator<int>::from_array(values.data(), static_cast<int>(values.size()));
+		auto prefetched = source.prefetch(4, WorkStealingExecutor::Shared());
+		auto prefetchSum = prefetched.fold(0L, [](long acc, int value) { return acc + value; });
+
+		/// 提前销毁时后台任务可能正在生产，也可能刚因为缓冲区满而退出，析构要等它不再访问上游
+		auto earlySource = Generator<int>::from_array(values.data(), static_cast<int>(values.size()));
+		int taken = 0;
+		{
+			auto early = earlySource.prefetch(4, WorkStealingExecutor::Shared());
+			while (taken < 10 && early.has_next())
+			{
+				early.next();
+				++taken;
+			}
+		}
+		std::cout << "prefetch: " << prefetchSum << ", stopped after " << taken << std::endl;
+	}
+	{
+		/// 按块处理，每 256 个元素才恢复一次协程
+		/// odd 是在临时对象上调用 filter 得到的，上游移动进了 odd 的协程帧；squares 的上游 odd 是具名的
+		std::vector<int> values(10000);
+		std::iota(values.begin(), values.end(), 1);
+		auto odd = GeneratorChunk<int>::from_array(values.data(), values.size())
+			.filter([](int value) { return (value & 1) == 1; });
+		auto squares = odd.map([](int value) { return static_cast<long>(value) * value; });
+		auto chunkSum = squares.fold(0L, [](long acc, long value) { return acc + value; });
+		/// 逐个传值的 Generator 攒成块
+		int countChunks = 0;
+		GeneratorChunk<int>::from(Generator<int>::from_array(values.data(), static_cast<int>(values.size())), 1000)
+			.for_each_chunk([&](std::span<const int>) { ++countChunks; });
+		std::cout << "chunked odd squares: " << chunkSum << " in " << countChunks << " chunks" << std::endl;
+	}
+	{
+		/// 融合的管道，filter/map/take_while/take 组合成一个回调，只有 flat_map 展开的子 Generator 是协程
+		std::vector<int> values(100);
+		std::iota(values.begin(), values.end(), 1);
+		auto fusedSum = fused::from(values)
+			| fused::filter([](int value) { return (value & 1) == 1; })
+			| fused::map([](int value) { return value * 3; })
+			| fused::fold(0L, [](long acc, int value) { return acc + value; });
+		/// 重新包装成 Generator，可以接着用 Generator 的组合子
+		auto expanded = Generator<int>::from_array(values.data(), static_cast<int>(values.size()))
+			| fused::take_while([](int value) { return value <= 4; })
+			| fused::flat_map([](int value) -> Generator<int> {
+			for (int i = 0; i < value; ++i)
+			{
+				co_yield value;
+			}
+				})
+			| fused::to_generator();
+		auto nExpanded = expanded.fold(0, [](int count, int) { return count + 1; });
+		std::cout << "fused pipeline: " << fusedSum << ", expanded to " << nExpanded << " values:";
+		fused::from(values) | fused::take(5) | fused::for_each([](int value) { std::cout << " " << value; });
+		std::cout << std::endl;
+	}
+
+	{
+		std::stop_source stopSource;
+		start = std::chrono::steady_clock::now();
+		auto cancellable = CancellableTask(stopSource.get_token());
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		stopSource.request_stop();
+		auto result = cancellable.GetResult();
+		elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		std::cout << "cancelled task: " << result << " in " << elapsed.count() << "ms" << std::endl;
+	}
+
+	{
+		// 只在源头指定 token，filter/flat_map 继承它，请求取消后整条管道都停下来
+		// flat_map 展开到一半时也会马上停下，不会把当前的内层 Generator 取完
+		std::stop_source stopSource;
+		auto naturals = Naturals();
+		naturals.set_stop_token(stopSource.get_token());
+		// 成员函数协程只保存上游的地址，每一级都要有名字
+		auto evens = naturals.filter([](int i) { return i % 2 == 0; });
+		auto pipeline = evens.flat_map([](int i) { return Generator<int>::from(i, -i); });
+		int count = 0;
+		bool bStopped = false;
+		while (pipeline.has_next())
+		{
+			if (bStopped)
+			{
+				std::cerr << "cancelled pipeline did not stop" << std::endl;
+				return 1;
+			}
+			if (pipeline.next() >= 100)
+			{
+				stopSource.request_stop();
+				bStopped = true;
+			}
+			++count;
+		}
+		std::cout << "cancelled pipeline: " << count << " values" << std::endl;
+	}
+
+#if defined(__linux__)
+	{
+		EventLoopExecutor loop;
+		int fds[2];
+		::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+		auto n = PingPong(loop, fds[0], fds[1]).GetResult();
+		std::cout << "ping pong on " << loop.BackendName() << ": " << n << " bytes" << std::endl;
+		::close(fds[0]);
+		::close(fds[1]);
+
+		auto nOnLoop = ConsumeTicks(ThreadPoolExecutor::Shared(), loop, 20).GetResult();
+		std::cout << "async generator across executors: " << nOnLoop << " values handled on the event loop" << std::endl;
+	}
+
+	{
+		auto directory = std::filesystem::temp_directory_path();
+		auto input = (directory / ("cppfeature_access_" + std::to_string(::getpid()) + ".log")).string();
+		auto output = (directory / ("cppfeature_errors_" + std::to_string(::getpid()) + ".log")).string();
+		{
+			BufferedFileSink log(input);
+			for (int i = 0; i < 1000; ++i)
+			{
+				log.WriteLine("GET /page/" + std::to_string(i) + (i % 7 == 0 ? " 500 " : " 200 ") + "12ms");
+			}
+			log.Flush();
+		}
+		FilterErrors(input, output);
+		MappedFile result(output);
+		auto errors = mapped_lines(result);
+		auto count = errors.fold(0, [](int acc, std::string_view) { return acc + 1; });
+		std::cout << "mapped file: " << count << " error lines" << std::endl;
+		std::filesystem::remove(input);
+		std::filesystem::remove(output);
+	}
+#endif
+
+#if CPPFEATURE_CORO_INSTRUMENTATION
+	/// 所有线程合并后的统计，时间单位是纳秒
+	auto metrics = CoroutineMetrics::Snapshot().Total();
+	std::cout << "segments: " << metrics.m_Segment.m_nCount
+		<< ", p50 " << metrics.m_Segment.Percentile(0.5) << "ns"
+		<< ", p99 " << metrics.m_Segment.Percentile(0.99) << "ns"
+		<< ", start delay p99 " << metrics.m_StartDelay.Percentile(0.99) << "ns"
+		<< ", max queue depth " << metrics.m_QueueDepth.m_nMax << std::endl;
+#endif
+	return 0;
+}